@@ -54,9 +54,15 @@
 #      include "../user_script.h"
 
 #      include <Windows.h>
+#      include <array>
 #      include <atomic>
+#      include <chrono>
+#      include <deque>
 #      include <functional>
 #      include <list>
+#      include <memory>
+#      include <mutex>
+#      include <vector>
 
 #      ifndef WIN32_LEAN_AND_MEAN
 #         define WIN32_LEAN_AND_MEAN
@@ -83,19 +89,30 @@
 namespace webview {
 class user_script::impl {
 public:
-   impl(std::wstring id, std::wstring code);
+   // The script id is only known once AddScriptToExecuteOnDocumentCreated
+   // completes, until then the script is pending
+   struct State {
+      std::wstring                           id_{};
+      bool                                   ready_{false};
+      bool                                   removed_{false};
+      std::vector<std::function<void(bool)>> on_ready_{};
+   };
+
+   explicit impl(std::wstring code);
+   ~impl();
 
    impl(const impl&)            = delete;
    impl& operator=(const impl&) = delete;
    impl(impl&&)                 = delete;
    impl& operator=(impl&&)      = delete;
 
-   const std::wstring& GetId() const { return id_; }
-   const std::wstring& GetCode() const { return code_; }
+   const std::wstring&           GetId() const { return state_->id_; }
+   const std::wstring&           GetCode() const { return code_; }
+   std::shared_ptr<State> const& GetState() const { return state_; }
 
 private:
-   std::wstring id_;
-   std::wstring code_;
+   std::shared_ptr<State> state_{std::make_shared<State>()};
+   std::wstring           code_;
 };
 
 namespace detail {
@@ -195,7 +212,8 @@ public:
        []() constexpr {
           /* No-op: default termination handler. Add custom cleanup if needed. */
        },
-     bool invisible = false
+     bool                invisible = false,
+     TimerQueue::clock_t clock     = &TimerQueue::clock::now
    );
 
    ~Win32EdgeEngine() final;
@@ -239,6 +257,7 @@ public:
    void Run() final;
    void Terminate() final;
 
+   using Webview::Eval;
    void Eval(
      std::string_view                                                             js,
      std::optional<std::function<void(std::optional<std::string> const&)>> const& callback =
@@ -248,7 +267,9 @@ public:
 
    void OpenDevTools() final;
 
-   void Dispatch(std::function<void()> f) final;
+   using Webview::Dispatch;
+   void Dispatch(std::function<void()> f, Priority priority) final;
+   void DispatchIdle(idle_task_t task) final;
 
    //---------------------------------------------------------------------------------------------------------------------
    Microsoft::WRL::ComPtr<ICoreWebView2WebResourceResponse>
@@ -258,6 +279,8 @@ public:
 
 private:
    void NavigateImpl(std::string_view url) final;
+   void ScheduleTimers(std::chrono::milliseconds delay) final;
+   void Resume(std::coroutine_handle<> handle) final;
 
    std::multimap<std::wstring, url_handler_t, std::less<>> handlers_;
 
@@ -269,6 +292,8 @@ private:
    );
 
    user_script AddUserScriptImpl(std::string_view js) final;
+   void OnUserScriptReady(user_script const& script, std::function<void(bool)> callback) final;
+   void        RemoveUserScriptImpl(user_script const& script) final;
    void        RemoveAllUserScript(std::list<user_script> const& scripts) final;
    bool        AreUserScriptsEqual(user_script const& first, user_script const& second) final;
 
@@ -292,6 +317,23 @@ private:
    // Blocks while depleting the run loop of events.
    void DepleteRunLoopEventQueue();
 
+   // Runs dispatched tasks, higher lanes first, until the lanes are empty or
+   // the time budget of the turn is spent
+   void DrainDispatchQueue();
+
+   struct DispatchTask {
+      std::function<void()>                 task_{};
+      std::chrono::steady_clock::time_point queued_{};
+   };
+
+   std::mutex                                       dispatch_mutex_{};
+   std::array<std::deque<DispatchTask>, PRIORITIES> dispatch_lanes_{};
+   bool                                             drain_posted_{false};
+   std::deque<idle_task_t>                          idle_tasks_{};
+
+   // Runs idle tasks for a slice, returns whether some remain
+   bool RunIdleTasks();
+
    // The app is expected to call CoInitializeEx before
    // CreateCoreWebView2EnvironmentWithOptions.
    // Source:
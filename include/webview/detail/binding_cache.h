@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace webview {
+
+/// Results of a pure binding keyed by their raw JSON params, least recently
+/// used entries are evicted first. Thread safe.
+class BindingCache {
+public:
+   using clock = std::chrono::steady_clock;
+
+   BindingCache(std::size_t capacity, std::optional<std::chrono::milliseconds> ttl);
+
+   std::optional<std::string> Find(std::string_view params);
+   void                       Store(std::string params, std::string result);
+   void                       Clear();
+
+private:
+   struct Entry {
+      std::string       params_{};
+      std::string       result_{};
+      clock::time_point expires_{};
+   };
+
+   std::size_t const                              capacity_;
+   std::optional<std::chrono::milliseconds> const ttl_;
+
+   std::mutex mutex_{};
+   // Most recently used first
+   std::list<Entry>                                                 entries_{};
+   std::unordered_map<std::string_view, std::list<Entry>::iterator> index_{};
+};
+
+}  // namespace webview
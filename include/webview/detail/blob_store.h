@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../http.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace webview {
+
+/// Byte buffers exchanged with the page through plain http requests, avoiding
+/// JSON (and base64) encoding of binary payloads.
+///
+/// A published buffer is fetched by JS with fetch(url) (e.g. as an
+/// ArrayBuffer), an upload url receives the body of fetch(url, {method:
+/// "POST", body}). Urls stay valid as long as their Handle is alive.
+class BlobStore : public std::enable_shared_from_this<BlobStore> {
+public:
+   static constexpr std::string_view ORIGIN{"https://webview.blob"};
+
+   using upload_t = std::function<void(std::vector<char> data)>;
+
+   class Handle {
+   public:
+      Handle() = default;
+      Handle(std::weak_ptr<BlobStore> store, std::string id);
+      ~Handle();
+
+      Handle(Handle const&)            = delete;
+      Handle& operator=(Handle const&) = delete;
+      Handle(Handle&& other) noexcept;
+      Handle& operator=(Handle&& other) noexcept;
+
+      std::string const& Url() const { return url_; }
+
+      void Release();
+
+   private:
+      std::weak_ptr<BlobStore> store_{};
+      std::string              id_{};
+      std::string              url_{};
+   };
+
+   Handle Publish(std::vector<char> data, std::string_view content_type);
+   Handle Receive(upload_t on_upload);
+
+   std::optional<http::response_t> Serve(http::request_t const& request);
+
+private:
+   struct Blob {
+      std::shared_ptr<std::vector<char> const> data_{};
+      std::string                              content_type_{};
+      upload_t                                 on_upload_{};
+   };
+
+   Handle Add(Blob blob);
+   void   Remove(std::string const& id);
+
+   std::mutex                            mutex_{};
+   std::unordered_map<std::string, Blob> blobs_{};
+};
+
+using BlobHandle = BlobStore::Handle;
+
+}  // namespace webview
@@ -0,0 +1,627 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+/// Bridge scripts are minified at compile time unless told otherwise, only
+/// readable scripts are injected in debug builds.
+#ifndef WEBVIEW_MINIFY_BRIDGE
+#   ifdef NDEBUG
+#      define WEBVIEW_MINIFY_BRIDGE 1
+#   else
+#      define WEBVIEW_MINIFY_BRIDGE 0
+#   endif
+#endif
+
+namespace webview::bridge {
+
+template <std::size_t N>
+struct FixedString {
+   consteval FixedString() = default;
+   consteval FixedString(char const (&str)[N]) {
+      for (std::size_t i = 0; i < N; ++i) {
+         data_[i] = str[i];
+      }
+   }
+
+   constexpr std::string_view View() const { return {data_, N - 1}; }
+
+   char data_[N]{};
+};
+
+/// Drops indentation, blank lines and line comments. Line breaks are kept so
+/// that automatic semicolon insertion behaves as in the source. Writes to out
+/// when given, returns the minified size either way.
+consteval std::size_t
+Minify(std::string_view src, char* out = nullptr) {
+   std::size_t size{0};
+
+   while (!src.empty()) {
+      auto const end  = src.find('\n');
+      auto       line = src.substr(0, end);
+      src             = end == std::string_view::npos ? std::string_view{} : src.substr(end + 1);
+
+      auto const first = line.find_first_not_of(" \t\r");
+      if (first == std::string_view::npos) {
+         continue;
+      }
+      line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+
+      if (line.starts_with("//")) {
+         continue;
+      }
+
+      if (size && out) {
+         out[size] = '\n';
+      }
+      size += size ? 1 : 0;
+
+      for (auto const c : line) {
+         if (out) {
+            out[size] = c;
+         }
+         ++size;
+      }
+   }
+
+   return size;
+}
+
+template <FixedString SRC>
+consteval auto
+Minified() {
+   FixedString<Minify(SRC.View()) + 1> result{};
+   Minify(SRC.View(), result.data_);
+   return result;
+}
+
+template <FixedString SRC>
+inline constexpr auto SCRIPT = []() consteval {
+   if constexpr (WEBVIEW_MINIFY_BRIDGE) {
+      return Minified<SRC>();
+   } else {
+      return SRC;
+   }
+}();
+
+// Both scripts are function expressions, only their arguments are appended
+// at runtime: (post_fn, "nonce") and (["name", ...], "nonce", ["signature", ...],
+// [{ size, ttl } | null, ...]) respectively.
+inline constexpr std::string_view INIT_SCRIPT = SCRIPT<R"js(
+(function(post, NONCE) {
+   'use strict';
+
+   function generateId() {
+      var crypto = window.crypto || window.msCrypto;
+      var bytes = new Uint8Array(16);
+      crypto.getRandomValues(bytes);
+
+      return Array.prototype.slice.call(bytes).map(function(n) {
+         var s = n.toString(16);
+         return ((s.length % 2) == 1 ? '0' : '') + s;
+      }).join('');
+   }
+
+   // Messages are tagged with the document they come from, so that the
+   // calls of a previous document are dropped natively
+   var DOCUMENT = generateId();
+
+   var Webview = (function() {
+      var _promises = {};
+      function Webview_() {}
+
+      var _queue = [];
+
+      // Set when bindings are exposed through a namespace instead of window
+      var _namespace = null;
+      var _namespaceTarget = null;
+      var _lazy = Object.create(null);
+
+      // index is only set for static bindings, which are resolved by index
+      // instead of by name. Aborting signal rejects the call with the reason
+      // of the signal and cancels it natively.
+      function invoke(self, method, index, nonce, params, signal) {
+         if (nonce != NONCE) {
+            throw new Error('Invalid nonce \"' + nonce + '\"');
+         }
+
+         if (signal && signal.aborted) {
+            return Promise.reject(signal.reason);
+         }
+
+         var _id = generateId();
+         var promise = new Promise(function(resolve, reject) {
+            _promises[_id] = { resolve, reject };
+         });
+
+         var message = {
+            nonce: nonce,
+            reverse: false,
+            id: _id,
+            method: method,
+            params: JSON.stringify(params)
+         };
+         if (index !== undefined) {
+            message.index = index;
+         }
+
+         if (signal) {
+            var onAbort = function() {
+               var pending = _promises[_id];
+               delete _promises[_id];
+               pending.reject(signal.reason);
+
+               self.enqueue({
+                  nonce: nonce,
+                  reverse: false,
+                  id: _id,
+                  method: method,
+                  params: '',
+                  cancel: true
+               }, nonce);
+            };
+
+            signal.addEventListener('abort', onAbort);
+            _promises[_id].release = function() {
+               signal.removeEventListener('abort', onAbort);
+            };
+         }
+
+         self.enqueue(message, nonce);
+         return promise;
+      }
+
+      // An AbortSignal given as last argument is not sent to the binding
+      function takeSignal(params) {
+         var last = params[params.length - 1];
+         if (typeof AbortSignal != 'undefined' && last instanceof AbortSignal) {
+            return params.pop();
+         }
+         return undefined;
+      }
+
+      // signature has one type per argument (see bridge::SIGNATURE): n(umber),
+      // s(tring), b(oolean) or * (not checked), followed by ? when optional.
+      // Missing optional arguments are sent as null.
+      function validate(name, signature, params) {
+         var types = signature.match(/[nsb*]\??/g) || [];
+         if (params.length > types.length) {
+            return name + ' expects at most ' + types.length + ' argument(s), got ' + params.length;
+         }
+
+         var expected = { n: 'number', s: 'string', b: 'boolean' };
+         for (var i = 0; i < types.length; ++i) {
+            var type = expected[types[i][0]];
+
+            if (params[i] === undefined || params[i] === null) {
+               if (types[i].length == 2) {
+                  params[i] = null;
+               } else if (type !== undefined) {
+                  return name + ': argument ' + i + ' is required';
+               }
+            } else if (type !== undefined && typeof params[i] != type) {
+               return name + ': argument ' + i + ' must be a ' + type + ', got ' + typeof params[i];
+            }
+         }
+
+         return null;
+      }
+
+      // cache ({ size, ttl }) is set for pure bindings, results are reused for
+      // the same arguments (least recently used are evicted first). Failed
+      // calls aren't cached.
+      function cached(cache, params, call) {
+         var key = JSON.stringify(params);
+         var entry = cache.entries.get(key);
+
+         cache.entries.delete(key);
+         if (entry && (entry.expires === undefined || entry.expires > Date.now())) {
+            cache.entries.set(key, entry);
+            return entry.promise;
+         }
+
+         entry = {
+            promise: call(),
+            expires: cache.ttl === undefined ? undefined : Date.now() + cache.ttl
+         };
+
+         cache.entries.set(key, entry);
+         if (cache.entries.size > cache.size) {
+            cache.entries.delete(cache.entries.keys().next().value);
+         }
+
+         entry.promise.catch(function() {
+            if (cache.entries.get(key) === entry) {
+               cache.entries.delete(key);
+            }
+         });
+         return entry.promise;
+      }
+
+      function stub(self, name, nonce, index, signature, cache) {
+         if (cache) {
+            cache = { size: cache.size, ttl: cache.ttl, entries: new Map() };
+         }
+
+         return function() {
+            var params = Array.prototype.slice.call(arguments);
+            var signal = takeSignal(params);
+
+            if (signature !== undefined) {
+               var error = validate(name, signature, params);
+               if (error) {
+                  return Promise.reject(new TypeError(error));
+               }
+            }
+
+            // Cached promises are shared, a signal only aborts its own call
+            if (cache && !signal) {
+               return cached(cache, params, function() {
+                  return invoke(self, name, index, nonce, params);
+               });
+            }
+
+            return invoke(self, name, index, nonce, params, signal);
+         };
+      }
+
+      Webview_.prototype.post = function(message, nonce) {
+         return post(message, nonce);
+      };
+
+      // Messages queued during the same task are posted at once (as an array)
+      // when the microtask queue is processed.
+      Webview_.prototype.enqueue = function(message, nonce) {
+         if (_queue.length == 0) {
+            queueMicrotask(() => {
+               var messages = _queue;
+               _queue = [];
+
+               this.post(JSON.stringify(messages.length == 1 ? messages[0] : messages), nonce);
+            });
+         }
+
+         message.document = DOCUMENT;
+         _queue.push(message);
+      };
+
+      Webview_.prototype.call = function(method, nonce) {
+         var params = Array.prototype.slice.call(arguments, 2);
+         var signal = takeSignal(params);
+
+         return invoke(this, method, undefined, nonce, params, signal);
+      };
+
+      Webview_.prototype.reverseCall = function(method, _id, nonce, _params) {
+         if (nonce != NONCE) {
+            throw new Error('Invalid nonce \"' + nonce + '\"');
+         }
+
+         if (!window.hasOwnProperty(method)) {
+            this.enqueue({
+                  nonce: nonce,
+                  reverse: true,
+                  id: _id,
+                  method: method,
+                  error: true,
+                  result: JSON.stringify('Property \"' + method + '\" doesn\'t exists')
+               }, nonce);
+         } else {
+            window[method].apply(null, _params).then((result) => {
+               this.enqueue({
+                     nonce: nonce,
+                     reverse: true,
+                     id: _id,
+                     method: method,
+                     error: false,
+                     result: JSON.stringify(result)
+                  }, nonce);
+            }).catch((error) => {
+               this.enqueue({
+                     nonce: nonce,
+                     reverse: true,
+                     id: _id,
+                     method: method,
+                     error: true,
+                     result: JSON.stringify(error)
+                  }, nonce);
+            });
+         }
+      }
+
+      function settle(id, error, result) {
+         var promise = _promises[id];
+         if (promise === undefined) {
+            return;
+         }
+         delete _promises[id];
+
+         if (promise.release) {
+            promise.release();
+         }
+
+         if (result !== undefined) {
+            try {
+               result = JSON.parse(result);
+            } catch (e) {
+               promise.reject(new Error("Failed to Parse binding result as JSON"));
+               return;
+            }
+         }
+
+         if (error) {
+            promise.reject(result);
+         } else {
+            promise.resolve(result);
+         }
+      }
+
+      Webview_.prototype.onReply = function(id, error, result, nonce) {
+         if (nonce != NONCE) {
+            throw new Error('Invalid nonce \"' + nonce + '\"');
+         }
+
+         settle(id, error, result);
+      };
+
+      Webview_.prototype.onReplies = function(replies, nonce) {
+         if (nonce != NONCE) {
+            throw new Error('Invalid nonce \"' + nonce + '\"');
+         }
+
+         replies.forEach(function(reply) {
+            settle(reply[0], reply[1], reply[2]);
+         });
+      };
+
+      Webview_.prototype.onBind = function(name, nonce, index, signature, cache) {
+         if (nonce != NONCE) {
+            throw new Error('Invalid nonce \"' + nonce + '\"');
+         }
+
+         if (_namespace) {
+            // Materialized on first access through the namespace
+            _lazy[name] = { index: index, signature: signature, cache: cache };
+            return;
+         }
+
+         if (window.hasOwnProperty(name)) {
+            throw new Error('Property \"' + name + '\" already Exists');
+         }
+
+         window[name] = stub(this, name, nonce, index, signature, cache);
+      };
+
+      Webview_.prototype.onNamespace = function(namespace, nonce) {
+         if (nonce != NONCE) {
+            throw new Error('Invalid nonce \"' + nonce + '\"');
+         }
+
+         if (window.hasOwnProperty(namespace)) {
+            throw new Error('Property \"' + namespace + '\" already Exists');
+         }
+
+         var self = this;
+         var stubs = {};
+
+         _namespace = new Proxy(stubs, {
+            get: function(target, name) {
+               if (!target.hasOwnProperty(name) && _lazy[name]) {
+                  var lazy = _lazy[name];
+                  target[name] = stub(self, name, nonce, lazy.index, lazy.signature, lazy.cache);
+               }
+               return target[name];
+            },
+            has: function(target, name) {
+               return !!_lazy[name];
+            },
+            ownKeys: function(target) {
+               return Object.keys(_lazy);
+            },
+            getOwnPropertyDescriptor: function(target, name) {
+               if (!_lazy[name]) {
+                  return undefined;
+               }
+               return {
+                  value: this.get(target, name),
+                  writable: false,
+                  enumerable: true,
+                  configurable: true
+               };
+            }
+         });
+         _namespaceTarget = stubs;
+
+         Object.defineProperty(window, namespace, { value: _namespace });
+      };
+
+      Webview_.prototype.onUnbind = function(name, nonce) {
+         if (nonce != NONCE) {
+            throw new Error('Invalid nonce \"' + nonce + '\"');
+         }
+
+         if (_namespace) {
+            if (!_lazy[name]) {
+               throw new Error('Property \"' + name + '\" does not exist');
+            }
+
+            delete _lazy[name];
+            delete _namespaceTarget[name];
+            return;
+         }
+
+         if (!window.hasOwnProperty(name)) {
+            throw new Error('Property \"' + name + '\" does not exist');
+         }
+
+         delete window[name];
+      };
+
+      return Webview_;
+   })();
+
+   window.__webview__ = new Webview();
+
+   // Lets the native side know that the calls of the previous document won't
+   // ever be answered
+   if (window === window.top) {
+      window.__webview__.enqueue({
+         nonce: NONCE,
+         reverse: false,
+         id: '',
+         method: '',
+         params: '',
+         hello: true
+      }, NONCE);
+   }
+})
+)js">.View();
+
+inline constexpr std::string_view BIND_SCRIPT = SCRIPT<R"js(
+(function(methods, NONCE, signatures, caches) {
+   'use strict';
+
+   methods.forEach(function(name, i) {
+      window.__webview__.onBind(name, NONCE, undefined, signatures[i], caches[i]);
+   });
+})
+)js">.View();
+
+// Same as BIND_SCRIPT, bindings are identified by their index in methods
+inline constexpr std::string_view STATIC_BIND_SCRIPT = SCRIPT<R"js(
+(function(methods, NONCE, signatures) {
+   'use strict';
+
+   methods.forEach(function(name, index) {
+      window.__webview__.onBind(name, NONCE, index, signatures[index]);
+   });
+})
+)js">.View();
+
+/// JSON array of strings, built at compile time. Writes to out when given,
+/// returns the size either way.
+template <std::size_t N>
+consteval std::size_t
+JsonArray(std::array<std::string_view, N> const& names, char* out = nullptr) {
+   std::size_t size{0};
+
+   auto const write = [&](char c) constexpr {
+      if (out) {
+         out[size] = c;
+      }
+      ++size;
+   };
+
+   write('[');
+   for (std::size_t i = 0; i < N; ++i) {
+      if (i) {
+         write(',');
+      }
+
+      write('"');
+      for (auto const c : names[i]) {
+         if (c == '"' || c == '\\') {
+            write('\\');
+            write(c);
+         } else if (static_cast<unsigned char>(c) < 0x20) {
+            // Control characters as \u00XX
+            constexpr std::string_view HEX{"0123456789abcdef"};
+            for (auto const e : std::string_view{"\\u00"}) {
+               write(e);
+            }
+            write(HEX[static_cast<unsigned char>(c) >> 4]);
+            write(HEX[static_cast<unsigned char>(c) & 0xF]);
+         } else {
+            write(c);
+         }
+      }
+      write('"');
+   }
+   write(']');
+
+   return size;
+}
+
+template <FixedString... STRINGS>
+consteval auto
+JsonArray() {
+   constexpr std::array<std::string_view, sizeof...(STRINGS)> strings{STRINGS.View()...};
+
+   FixedString<JsonArray(strings) + 1> result{};
+   JsonArray(strings, result.data_);
+   return result;
+}
+
+template <FixedString... NAMES>
+consteval auto
+NamesArray() {
+   constexpr std::array<std::string_view, sizeof...(NAMES)> names{NAMES.View()...};
+
+   for (std::size_t i = 0; i < names.size(); ++i) {
+      for (std::size_t j = i + 1; j < names.size(); ++j) {
+         if (names[i] == names[j]) {
+            throw "Duplicate binding name";
+         }
+      }
+   }
+
+   return JsonArray<NAMES...>();
+}
+
+template <class T>
+struct IsOptional : std::false_type {};
+
+template <class T>
+struct IsOptional<std::optional<T>> : std::true_type {};
+
+/// Type of a binding argument as checked by the JS stub, followed by '?' when
+/// it may be omitted. Writes to out when given, returns the size either way.
+template <class ARG>
+consteval std::size_t
+ArgSignature(char* out) {
+   using type = std::remove_cvref_t<ARG>;
+
+   if constexpr (IsOptional<type>::value) {
+      auto const size = ArgSignature<typename type::value_type>(out);
+      if (out) {
+         out[size] = '?';
+      }
+      return size + 1;
+   } else {
+      char signature = '*';
+      if constexpr (std::is_same_v<type, bool>) {
+         signature = 'b';
+      } else if constexpr (std::is_arithmetic_v<type>) {
+         signature = 'n';
+      } else if constexpr (std::is_convertible_v<type, std::string_view>) {
+         signature = 's';
+      }
+
+      if (out) {
+         *out = signature;
+      }
+      return 1;
+   }
+}
+
+template <class... ARGS>
+consteval std::size_t
+Signature(std::tuple<ARGS...> const*, char* out = nullptr) {
+   std::size_t size{0};
+   ((size += ArgSignature<ARGS>(out ? out + size : nullptr)), ...);
+   return size;
+}
+
+/// Argument types of a binding taking the ARGS tuple
+template <class ARGS>
+inline constexpr auto SIGNATURE = []() consteval {
+   FixedString<Signature(static_cast<ARGS const*>(nullptr)) + 1> result{};
+   Signature(static_cast<ARGS const*>(nullptr), result.data_);
+   return result;
+}();
+
+}  // namespace webview::bridge
@@ -0,0 +1,121 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Serge Zaitsev
+ * Copyright (c) 2022 Steffen André Langnes
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "../http.h"
+#include "engine_base.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace webview {
+
+/// Serves a directory from disk through a url_handler_t.
+///
+/// File contents and metadata are cached in memory. While watching is
+/// enabled, the tree is monitored (ReadDirectoryChangesW on Windows, inotify
+/// on Linux) and only the entries that changed are invalidated; otherwise each
+/// cached entry is revalidated against its size and modification time.
+class DirectoryHandler {
+public:
+   /// @param root   Directory to serve.
+   /// @param prefix Url prefix stripped from request uris (e.g. "https://app.local/").
+   /// @param watch  Watch the tree for changes instead of revalidating entries on each request.
+   DirectoryHandler(std::filesystem::path root, std::string_view prefix, bool watch = true);
+   ~DirectoryHandler();
+
+   DirectoryHandler(DirectoryHandler const&)            = delete;
+   DirectoryHandler& operator=(DirectoryHandler const&) = delete;
+   DirectoryHandler(DirectoryHandler&&)                 = delete;
+   DirectoryHandler& operator=(DirectoryHandler&&)      = delete;
+
+   /// Handler to be given to Webview::RegisterUrlHandler. It shares the cache
+   /// of this instance and remains valid after the instance is destroyed.
+   url_handler_t Handler() const;
+
+   /// Once a change is detected, dispatch a "webview:reload" CustomEvent on
+   /// the window (detail holds the changed paths), or reload the whole page
+   /// when full_reload is set.
+   ///
+   /// webview is used from the watcher thread: it must outlive this instance,
+   /// or StopNotify must be called before it is destroyed.
+   void NotifyReload(Webview& webview, bool full_reload = false);
+   /// Once returned, the webview given to NotifyReload isn't used anymore
+   void StopNotify();
+
+   void Invalidate(std::string_view path);
+   void Clear();
+
+private:
+   struct Entry {
+      http::response_t                response_{};
+      std::filesystem::file_time_type last_write_{};
+      std::uintmax_t                  size_{};
+   };
+
+   struct Cache {
+      std::filesystem::path                  root_{};
+      std::string                            prefix_{};
+      std::atomic_bool                       watched_{false};
+      std::atomic_uint64_t                   generation_{0};
+      std::shared_mutex                      mutex_{};
+      std::unordered_map<std::string, Entry> entries_{};
+
+      std::optional<http::response_t> Serve(http::request_t const& request);
+      void                            Invalidate(std::string_view path);
+
+   private:
+      std::optional<http::response_t> Load(http::request_t const& request);
+   };
+
+   bool Watch();
+   void OnChanged(std::vector<std::string> const& paths);
+
+   std::shared_ptr<Cache> cache_{std::make_shared<Cache>()};
+
+   std::shared_mutex                                      reload_mutex_{};
+   std::function<void(std::vector<std::string> const&)> on_changed_{};
+
+   std::atomic_bool stop_{false};
+#if defined(_WIN32)
+   void* stop_event_{nullptr};
+#else
+   int stop_fd_{-1};
+#endif
+   std::thread watcher_{};
+};
+
+}  // namespace webview
@@ -26,24 +26,39 @@
 #pragma once
 
 #include "../http.h"
+#include "binding_cache.h"
+#include "blob_store.h"
+#include "bridge_script.h"
+#include "thread_pool.h"
+#include "timer_queue.h"
 #include "promise/promise.h"
 #include "user_script.h"
 #include "utils/Nonce.h"
 
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <coroutine>
+#include <deque>
 #include <format>
 #include <functional>
 #include <list>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <shared_mutex>
 #include <sstream>
 #include <stdexcept>
+#include <stop_token>
 #include <string>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace webview {
 
@@ -85,12 +100,164 @@ struct MakeDeferred {
 };
 using url_handler_t = std::function<
   std::optional<http::response_t>(http::request_t const& request, std::unique_ptr<MakeDeferred>)>;
-using binding_t         = std::function<void(std::string_view id, std::string_view args)>;
+using binding_t =
+  std::function<void(std::string_view id, std::string_view args, std::stop_token stop)>;
 using reverse_binding_t = std::function<void(bool error, std::string_view result)>;
+// deadline is the end of the idle slice the task runs in
+using idle_task_t = std::function<void(std::chrono::steady_clock::time_point deadline)>;
+
+/// Lanes of Webview::Dispatch, drained in this order (tasks waiting too long
+/// in a lower lane are run first so that they aren't starved)
+enum class Priority { INTERACTIVE, NORMAL, BULK };
+
+inline constexpr std::size_t PRIORITIES{3};
+
+/// Options of Webview::Bind
+struct BindOptions {
+   /// The result only depends on the arguments: successful results are cached
+   /// natively, keyed by the JSON params
+   bool pure_{false};
+   /// Maximum number of results cached per binding
+   std::size_t cache_size_{64};
+   /// How long a cached result is reused, forever when unset
+   std::optional<std::chrono::milliseconds> ttl_{};
+   /// Results are also cached by the JS stub, repeated calls never leave the page
+   bool js_cache_{false};
+   /// Concurrent calls with the same params share a single call of the binding
+   bool single_flight_{false};
+
+   enum class Execution {
+      /// Arguments are parsed and the binding is started on the UI thread
+      UI,
+      /// Run by the worker pool shared by the bindings of the webview
+      POOL,
+      /// Run by a thread of its own
+      DEDICATED
+   };
+   Execution execution_{Execution::UI};
+
+   /// Maximum number of calls of the binding running at once, unlimited when 0.
+   /// Calls above the limit are queued before anything is allocated for them.
+   std::size_t max_in_flight_{0};
+   std::size_t max_queued_{1024};
+
+   enum class Overflow {
+      /// Queued in order, rejected once max_queued_ calls are waiting
+      FIFO,
+      /// Queued, the oldest queued call is rejected once the queue is full
+      DROP_OLDEST,
+      /// Rejected right away, nothing is queued
+      REJECT
+   };
+   Overflow overflow_{Overflow::FIFO};
+
+   /// Lane of the replies of the binding (and of its queued calls)
+   Priority priority_{Priority::NORMAL};
+};
+
+/// Counters of Webview::GetBindingStats
+struct BindingStats {
+   std::size_t calls_{0};
+   /// Calls replied from the cache of a pure binding
+   std::size_t cached_{0};
+   /// Calls joining a call in flight with the same params (single flight)
+   std::size_t deduplicated_{0};
+   /// Calls currently waiting for a slot (max_in_flight_)
+   std::size_t queued_{0};
+   /// Calls rejected or dropped from the queue
+   std::size_t shed_{0};
+};
+
+/// Arguments of a binding sent by JS. A binding may take a trailing
+/// std::stop_token, which is stopped once the JS caller aborts the call (with
+/// an AbortSignal given as last argument) or once its document goes away.
+template <class ARGS>
+struct JsArgs {
+   static constexpr bool STOPPABLE = false;
+   using type                      = ARGS;
+};
+
+template <class... ARGS>
+   requires(
+     sizeof...(ARGS) > 0
+     && std::is_same_v<
+       std::remove_cvref_t<std::tuple_element_t<sizeof...(ARGS) - 1, std::tuple<ARGS...>>>,
+       std::stop_token>
+   )
+struct JsArgs<std::tuple<ARGS...>> {
+   static constexpr bool STOPPABLE = true;
+   using type                      = typename decltype([]<std::size_t... I>(
+                                            std::index_sequence<I...>
+                                          ) {
+      return std::type_identity<std::tuple<std::tuple_element_t<I, std::tuple<ARGS...>>...>>{};
+   }(std::make_index_sequence<sizeof...(ARGS) - 1>{}))::type;
+};
+
+/// Binding known at compile time, see Webview::BindStatic
+template <bridge::FixedString NAME, auto FUNCTION>
+struct StaticBinding {
+   static constexpr auto name_     = NAME;
+   static constexpr auto function_ = FUNCTION;
+};
 
 class Webview {
+   using reply_t = std::function<void(bool error, std::optional<std::string> result)>;
+
+   struct BindingCounters {
+      std::atomic_size_t calls_{0};
+      std::atomic_size_t cached_{0};
+      std::atomic_size_t deduplicated_{0};
+      std::atomic_size_t queued_{0};
+      std::atomic_size_t shed_{0};
+   };
+
+   // Calls of a binding limited by BindOptions::max_in_flight_
+   struct Admission {
+      struct Queued {
+         reply_t               reply_{};
+         std::function<void()> start_{};
+      };
+
+      Admission(
+        std::size_t           max_in_flight,
+        std::size_t           max_queued,
+        BindOptions::Overflow overflow,
+        Priority              priority
+      );
+
+      std::size_t const           max_in_flight_;
+      std::size_t const           max_queued_;
+      BindOptions::Overflow const overflow_;
+      Priority const              priority_;
+
+      std::mutex         mutex_{};
+      std::size_t        in_flight_{0};
+      std::deque<Queued> queue_{};
+   };
+
+   // Ids of the calls waiting for the call in flight with the same params
+   struct InFlight {
+      std::mutex                                                mutex_{};
+      std::unordered_map<std::string, std::vector<std::string>> ids_{};
+   };
+
+   struct NamedBinding {
+      std::string                      name_{};
+      std::shared_ptr<binding_t>       binding_{};
+      // Argument types checked by the JS stub, see bridge::SIGNATURE
+      std::string_view                 signature_{};
+      // Options of the JS side cache when enabled
+      std::optional<std::string>       js_cache_{};
+      std::shared_ptr<BindingCounters> counters_{};
+   };
+
 public:
-   Webview(std::function<void()> on_terminate = []() constexpr {});
+   // clock is the one of DispatchAfter and DispatchAt, it can be replaced by a
+   // virtual one (see TimerQueue and RunTimers)
+   Webview(
+     std::function<void()> on_terminate = []() constexpr {},
+     TimerQueue::clock_t   clock        = &TimerQueue::clock::now
+   );
    virtual ~Webview() = default;
 
    void         Navigate(std::string_view url);
@@ -101,16 +268,151 @@ public:
    RegisterUrlHandlers(std::vector<std::string_view> const& filters, url_handler_t handler) = 0;
 
    template <class PROMISE>
-   void Bind(std::string_view name, PROMISE&& promise);
+   void Bind(std::string_view name, PROMISE&& promise, BindOptions const& options = {});
    void Unbind(std::string_view name);
 
+   // Collects bindings to be registered at once on Commit, with a single bind
+   // script and a single notification of the page
+   class BindTransaction {
+   public:
+      explicit BindTransaction(Webview& webview);
+
+      template <class PROMISE>
+      BindTransaction&
+      Bind(std::string_view name, PROMISE&& promise, BindOptions const& options = {});
+
+      // Throws WEBVIEW_ERROR_DUPLICATE (binding nothing) if any name is already bound
+      void Commit();
+
+   private:
+      Webview&                  webview_;
+      std::vector<NamedBinding> bindings_{};
+   };
+
+   BindTransaction BindAll();
+
+   // Bindings listed as StaticBinding<"name", function>... : their bind script
+   // is generated at compile time and calls are resolved by index rather than
+   // by name. Can only be called once.
+   template <class... BINDINGS>
+   void BindStatic();
+
+   // Expose bindings as window[name].binding instead of window.binding, stubs
+   // are only created once accessed. Must be set before anything is bound.
+   void SetBindingNamespace(std::string_view name);
+
    template <class RETURN, class... ARGS>
    auto& Call(std::string_view name, ARGS&&... args);
+   // Rejected with WEBVIEW_ERROR_TIMEOUT if JS doesn't answer within timeout,
+   // a late answer is ignored
+   template <class RETURN, class... ARGS>
+   auto& Call(std::chrono::milliseconds timeout, std::string_view name, ARGS&&... args);
+
+   // Calls made by Call still waiting for the answer of JS
+   std::size_t OutstandingReverseCalls() const;
+
+   // Throws WEBVIEW_ERROR_NOT_FOUND if name isn't bound
+   BindingStats GetBindingStats(std::string_view name) const;
+
+   // Maximum number of binding replies delivered by a single script, replies
+   // settled during the same loop turn are batched together.
+   void SetReplyBatchSize(std::size_t size);
+
+   // How long the destruction of the webview waits for the rejected promises
+   // to settle, the names of those which didn't are reported on std::cerr
+   void SetShutdownTimeout(std::chrono::milliseconds timeout);
 
    virtual void Run()                             = 0;
    virtual void Terminate()                       = 0;
-   virtual void Dispatch(std::function<void()> f) = 0;
-   virtual void SetTitle(std::string_view title)  = 0;
+   void         Dispatch(std::function<void()> f);
+   virtual void Dispatch(std::function<void()> f, Priority priority) = 0;
+   // Runs task from the UI thread once neither input nor dispatched tasks are
+   // pending. Idle tasks share slices of a few milliseconds: a task should
+   // return by the given deadline and queue itself again if work remains.
+   virtual void DispatchIdle(idle_task_t task) = 0;
+   // Replaces the task of key if it is still pending instead of queuing
+   // another one: only the latest update of key runs. EvalLatest shares the
+   // keys of DispatchLatest.
+   void DispatchLatest(
+     std::string_view      key,
+     std::function<void()> task,
+     Priority              priority = Priority::NORMAL
+   );
+   void EvalLatest(std::string_view key, std::string js);
+
+   // Awaitables resuming the coroutine on the UI thread:
+   // - OnUiThread() right away when already there,
+   // - YieldToLoop() once the events already queued are processed,
+   // - SleepUntil(deadline) once deadline is reached, as a DispatchAt timer.
+   // The first two post the handle as is (no task is allocated). Coroutines
+   // still suspended when the webview is destroyed are destroyed with it.
+   auto OnUiThread() {
+      struct Awaitable {
+         Webview& webview_;
+
+         bool await_ready() const noexcept { return webview_.IsUiThread(); }
+         void await_suspend(std::coroutine_handle<> handle) {
+            if (webview_.Suspend(handle)) {
+               webview_.Resume(handle);
+            }
+         }
+         void await_resume() const noexcept {}
+      };
+
+      return Awaitable{*this};
+   }
+
+   auto YieldToLoop() {
+      struct Awaitable {
+         Webview& webview_;
+
+         bool await_ready() const noexcept { return false; }
+         void await_suspend(std::coroutine_handle<> handle) {
+            if (webview_.Suspend(handle)) {
+               webview_.Resume(handle);
+            }
+         }
+         void await_resume() const noexcept {}
+      };
+
+      return Awaitable{*this};
+   }
+
+   auto SleepUntil(TimerQueue::time_point deadline) {
+      struct Awaitable {
+         Webview&               webview_;
+         TimerQueue::time_point deadline_;
+
+         bool await_ready() const noexcept { return false; }
+         void await_suspend(std::coroutine_handle<> handle) {
+            if (webview_.Suspend(handle)) {
+               webview_.DispatchAt(deadline_, [&webview = webview_, handle]() {
+                  if (webview.Unsuspend(handle)) {
+                     handle.resume();
+                  }
+               });
+            }
+         }
+         void await_resume() const noexcept {}
+      };
+
+      return Awaitable{*this, deadline};
+   }
+
+   bool IsUiThread() const;
+
+   // Runs task from the UI thread once delay has elapsed, or at deadline.
+   // Deadlines close to each other are coalesced (see TimerQueue).
+   TimerQueue::Id DispatchAfter(std::chrono::milliseconds delay, std::function<void()> task);
+   TimerQueue::Id DispatchAt(TimerQueue::time_point deadline, std::function<void()> task);
+   // Returns false if the task already ran (or is running)
+   bool           CancelDispatch(TimerQueue::Id id);
+   // Runs the tasks due by the timer clock from the UI thread. The backend
+   // runs it once the real delay to the earliest deadline has elapsed, when
+   // the clock is a virtual one it is to be invoked after advancing it.
+   void           RunTimers();
+
+   virtual void SetTitle(std::string_view title) = 0;
 
    virtual void SetSize(int width, int height, Hint hints) = 0;
    virtual void SetPos(int x, int y)                       = 0;
@@ -149,30 +451,68 @@ public:
        std::nullopt
    ) = 0;
 
+   // Resolves with the completion value of js parsed as RETURN, straight from
+   // the engine's script completion (a promise returned by js isn't awaited).
+   template <class RETURN>
+   auto& Eval(std::string_view js);
+
    virtual void OpenDevTools()           = 0;
    virtual void InstallResourceHandler() = 0;
 
    virtual user_script* AddUserScript(std::string_view js);
+   virtual void         RemoveUserScript(user_script const* script);
+
+   // Resolves once the engine has registered the script, without blocking the
+   // run loop in the meantime. Rejected if the script is removed before that.
+   auto& AddUserScriptAsync(std::string_view js);
+
+   // Binary payloads exchanged through the resource handler (see BlobStore),
+   // InstallResourceHandler must have been called for the urls to be served.
+   BlobHandle PublishBlob(
+     std::vector<char> data,
+     std::string_view  content_type = "application/octet-stream"
+   );
+   BlobHandle ReceiveBlob(BlobStore::upload_t on_upload);
 
 protected:
    virtual void NavigateImpl(std::string_view url) = 0;
 
    virtual user_script AddUserScriptImpl(std::string_view js) = 0;
-   virtual user_script*
-                ReplaceUserScript(user_script const& old_script, std::string_view new_script_code);
+   // Invokes callback once the engine is done registering script, with
+   // whether it succeeded. Backends registering scripts synchronously keep
+   // the default, which invokes it immediately.
+   virtual void OnUserScriptReady(user_script const& script, std::function<void(bool)> callback);
+   virtual void RemoveUserScriptImpl(user_script const& script)                          = 0;
    virtual void RemoveAllUserScript(std::list<user_script> const& scripts)               = 0;
    virtual bool AreUserScriptsEqual(user_script const& first, user_script const& second) = 0;
 
-   void        ReplaceBindScript();
+   std::string AddBindScript(std::vector<std::string> const& names);
+   void        RemoveBindScript(std::string const& name);
    void        AddInitScript(std::string_view post_fn);
    std::string CreateInitScript(std::string_view post_fn);
-   std::string CreateBindScript();
+   std::string CreateBindScript(std::vector<std::string> const& names);
 
    virtual void OnMessage(std::string_view msg);
    virtual void OnWindowCreated();
 
    virtual void OnWindowDestroyed(bool skip_termination = false);
 
+   // Resume handle from the UI thread, after the events already queued, once
+   // Unsuspend accepts it
+   virtual void Resume(std::coroutine_handle<> handle) = 0;
+
+   // Tracks the coroutines suspended by the awaitables. Suspend destroys
+   // handle (and returns false) once DestroySuspended ran, Unsuspend returns
+   // whether handle is still to be resumed. DestroySuspended is to be invoked
+   // on shutdown, once the events posted are processed.
+   bool Suspend(std::coroutine_handle<> handle);
+   bool Unsuspend(std::coroutine_handle<> handle);
+   void DestroySuspended();
+
+   // RunTimers is to be invoked from the UI thread once delay has elapsed,
+   // replacing any run already scheduled
+   virtual void ScheduleTimers(std::chrono::milliseconds delay) = 0;
+
    std::string_view GetNonce() const;
 
 private:
@@ -190,21 +530,142 @@ private:
    static unsigned int      IncWindowCount();
    static unsigned int      DecWindowCount();
 
+   // Shared with the running bindings, which may complete after the webview
+   // is destroyed when CleanPromises gave up waiting for them
+   struct Guard {
+      std::shared_mutex mutex_{};
+      bool              alive_{true};
+   };
+
+   // Runs f, which may use the webview, unless it was destroyed meanwhile
+   template <class F>
+   static void IfAlive(Guard& guard, F&& f);
+
+   // reply receives the outcome of the binding, the JSON representation of
+   // its result or of its error
    template <class PROMISE, class... ARGS>
-   auto MakeWrapper(PROMISE&& promise, std::string_view id, ARGS&&... args);
+   auto MakeWrapper(PROMISE&& promise, std::string_view id, reply_t reply, ARGS&&... args);
+
+   template <class RETURN, class... ARGS>
+   auto& CallImpl(
+     std::optional<std::chrono::milliseconds> timeout,
+     std::string_view                         name,
+     ARGS&&... args
+   );
+
+   template <class PROMISE>
+   NamedBinding
+   MakeBinding(std::string_view name, PROMISE&& promise, BindOptions const& options = {});
+   void         AddBindings(std::vector<NamedBinding> bindings);
+   void         AddStaticBindings(
+             std::string_view          names,
+             std::string_view          signatures,
+             std::vector<NamedBinding> bindings
+           );
+
+   // Starts the call if a slot is free, otherwise queues or rejects it
+   void Admit(
+     Admission&            admission,
+     BindingCounters&      counters,
+     reply_t const&        reply,
+     std::function<void()> start
+   );
+   void Release(Admission& admission, BindingCounters& counters);
+
+   // The calls made by or to the previous document won't ever be answered:
+   // bindings are stopped and their replies dropped, reverse calls rejected
+   void PurgeDocument();
+   // Rejects the reverse call, JS didn't answer in time
+   void ExpireCall(std::string const& id);
+
+   // Schedules the backend timer for the earliest deadline of timers_
+   void ArmTimers();
+
+   // result is the JSON representation of the binding result (undefined if empty)
+   void Reply(
+     std::string_view           id,
+     bool                       error,
+     std::optional<std::string> result   = std::nullopt,
+     Priority                   priority = Priority::NORMAL
+   );
+   void FlushReplies(Priority priority);
+
+   BlobStore&                  Blobs();
+   std::shared_ptr<ThreadPool> Pool();
 
    using bindings_t = std::unordered_map<std::string, std::shared_ptr<binding_t>>;
-   bindings_t bindings_{};
+   bindings_t                                        bindings_{};
+   std::unordered_map<std::string, std::string_view> signatures_{};
+   std::unordered_map<std::string, std::string>      js_caches_{};
+   std::unordered_map<std::string, std::shared_ptr<BindingCounters>> counters_{};
+   // Indexed as in the static bind script
+   std::vector<std::shared_ptr<binding_t>> static_bindings_{};
+   std::unordered_set<std::string>         static_names_{};
+   // BindStatic can only be called once, even with no binding
+   bool static_bound_{false};
+   // Binding calls of the current document until replied, stopped once
+   // aborted or once the document goes away (UI thread only)
+   std::unordered_map<std::string, std::stop_source> live_calls_{};
+   // Id of the document the bridge talks to, generated by the init script
+   std::string document_{};
    using reverse_bindings_t = std::unordered_map<std::string, std::shared_ptr<reverse_binding_t>>;
    reverse_bindings_t reverse_bindings_{};
+   // Timers of the calls with a timeout
+   std::unordered_map<std::string, TimerQueue::Id> call_timers_{};
+   std::atomic_size_t                              outstanding_calls_{0};
 
-   user_script*           bind_script_{};
+   TimerQueue timers_{};
+
+   std::mutex                suspended_mutex_{};
+   std::unordered_set<void*> suspended_{};
+   bool                      suspended_closed_{false};
+
+   // Each binding has its own script so that binding and unbinding never
+   // re-registers the scripts of the other bindings
+   std::unordered_map<std::string, user_script*>              bind_scripts_{};
+   std::unordered_map<user_script*, std::vector<std::string>> script_names_{};
+   user_script*                                               namespace_script_{nullptr};
    std::list<user_script> user_scripts_{};
    std::function<void()>  on_terminate_{};
 
    std::string nonce_{utils::Nonce() + utils::Nonce()};
+   // Webviews are created from the thread running their loop
+   std::thread::id const ui_thread_{std::this_thread::get_id()};
    std::size_t next_id_{0};
 
+   struct PendingReply {
+      std::string                id_{};
+      bool                       error_{false};
+      std::optional<std::string> result_{};
+   };
+
+   // Replies are batched and flushed in the lane of their binding
+   struct ReplyLane {
+      std::vector<PendingReply> replies_{};
+      bool                      scheduled_{false};
+   };
+
+   // Pending tasks of DispatchLatest
+   std::mutex                                             latest_mutex_{};
+   std::unordered_map<std::string, std::function<void()>> latest_{};
+
+   std::mutex                        replies_mutex_{};
+   std::array<ReplyLane, PRIORITIES> reply_lanes_{};
+   std::size_t                       reply_batch_size_{256};
+
+   std::chrono::milliseconds shutdown_timeout_{5000};
+   std::shared_ptr<Guard>    guard_{std::make_shared<Guard>()};
+
+   std::shared_ptr<BlobStore> blobs_{std::make_shared<BlobStore>()};
+   std::once_flag             blobs_handler_{};
+
+   std::shared_ptr<ThreadPool> pool_{};
+   std::once_flag              pool_created_{};
+
+   // Executors of the bindings, joined by CleanPromises
+   std::mutex                             executors_mutex_{};
+   std::vector<std::weak_ptr<ThreadPool>> executors_{};
+
    struct Promises {
       using Id = std::string;
 
@@ -222,6 +683,8 @@ private:
 
          void Detach() &&;
 
+         std::string_view Name() const { return name_; }
+
          template <class EXCEPTION, class... ARGS>
          void Reject(ARGS&&... args);
 
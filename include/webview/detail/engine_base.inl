@@ -69,184 +69,368 @@ Webview::Promises::Cleaner::Promise() {
    return static_cast<PROMISE&>(*promise_);
 }
 
+template <class F>
+void
+Webview::IfAlive(Guard& guard, F&& f) {
+   std::shared_lock lock{guard.mutex_};
+   if (guard.alive_) {
+      std::forward<F>(f)();
+   }
+}
+
 template <class PROMISE, class... ARGS>
 auto
-Webview::MakeWrapper(PROMISE&& promise, std::string_view id, ARGS&&... args) {
+Webview::MakeWrapper(PROMISE&& promise, std::string_view id, reply_t reply, ARGS&&... args) {
    using return_t = promise::return_t<promise::return_t<PROMISE>>;
 
    return
-     [this, &promise, &id, &args...]() constexpr {
+     [&promise, &reply, &args...]() constexpr {
         if constexpr (std::is_void_v<return_t>) {
            return MakePromise(promise, std::forward<ARGS>(args)...)
-             .Then([id = std::string{id}, this]() constexpr {
-                Dispatch([id = js::Stringify(id), this]() {
-                   Eval(R"(window.__webview__.onReply({}, false, undefined, "{}"))", id, nonce_);
-                });
-             });
+             .Then([reply]() constexpr { reply(false, std::nullopt); });
         } else {
            return MakePromise(promise, std::forward<ARGS>(args)...)
-             .Then([id{std::string{id}}, this](return_t const& result) constexpr {
-                Dispatch([id = js::Stringify(id), result = js::Stringify(result), this]() {
-                   Eval(
-                     R"(window.__webview__.onReply({}, false, {}, "{}"))",
-                     id,
-                     js::Stringify(result),
-                     nonce_
-                   );
-                });
+             .Then([reply](return_t const& result) constexpr {
+                reply(false, js::Stringify(result));
              });
         }
      }()
-       .Catch([id = std::string{id}, this](js::SerializableException const& exc) constexpr {
-          Dispatch([id = js::Stringify(id), exception = exc.Stringify(), this]() {
-             Eval(
-               R"(window.__webview__.onReply({}, true, {}, "{}"))",
-               id,
-               js::Stringify(exception),
-               nonce_
-             );
-          });
+       .Catch([reply](js::SerializableException const& exc) constexpr {
+          reply(true, exc.Stringify());
        })
-       .Catch([id = std::string{id}, this](std::exception const& exc) constexpr {
-          Dispatch([id        = js::Stringify(id),
-                    exception = js::Stringify(std::string_view{exc.what()}),
-                    this]() {
-             Eval(
-               R"(window.__webview__.onReply({}, true, {}, "{}"))",
-               id,
-               js::Stringify(exception),
-               nonce_
-             );
-          });
+       .Catch([reply](std::exception const& exc) constexpr {
+          reply(true, js::Stringify(std::string_view{exc.what()}));
        })
-       .Catch([id = std::string{id}, this](std::exception_ptr) constexpr {
-          Dispatch([id = js::Stringify(id), this]() {
-             Eval(R"(window.__webview__.onReply({}, true, "unknown exception", "{}"))", id, nonce_);
-          });
+       .Catch([reply](std::exception_ptr) constexpr {
+          reply(true, js::Stringify(std::string_view{"unknown exception"}));
        })
-       .Then([this, id = std::string{id}]() constexpr {
+       .Then([this, guard = guard_, id = std::string{id}]() constexpr {
           // Cleanup
 
-          Dispatch([this, id]() constexpr {
-             assert(promises_);
-             auto elem = promises_->handles_.find("bind_" + id);
+          IfAlive(*guard, [&]() constexpr {
+             Dispatch([this, id]() constexpr {
+                assert(promises_);
+                auto elem = promises_->handles_.find("bind_" + id);
 
-             if (elem != promises_->handles_.end()) {
-                // Detach the promise, as there is a slight chance that dispatch
-                // might be executed before the promise completes
-                std::move(elem->second).Detach();
+                if (elem != promises_->handles_.end()) {
+                   // Detach the promise, as there is a slight chance that
+                   // dispatch might be executed before the promise completes
+                   std::move(elem->second).Detach();
 
-                promises_->handles_.erase(elem);
-             } else {
-                assert(false);
-             }
+                   promises_->handles_.erase(elem);
+                } else {
+                   assert(false);
+                }
+             });
           });
        });
 }
 
 template <class PROMISE>
-void
-Webview::Bind(std::string_view name, PROMISE&& promise) {
-   if (!bindings_
-          .emplace(
-            name,
-            std::make_shared<binding_t>([this,
-                                         name    = std::string{name},
-                                         promise = std::forward<PROMISE>(promise
-                                         )](std::string_view id, std::string_view js_args) {
-               using args_t = promise::args_t<decltype(promise)>;
-
-               if (stop_) {
-                  return Dispatch([id = js::Stringify(id), this]() {
-                     Eval(
-                       R"(window.__webview__.onReply({}, true, {}, "{}"))",
-                       id,
-                       js::Stringify(std::string_view{"Terminated webview !"}),
-                       nonce_
-                     );
-                  });
+Webview::NamedBinding
+Webview::MakeBinding(std::string_view name, PROMISE&& promise, BindOptions const& options) {
+   using callable_t = std::remove_cvref_t<PROMISE>;
+   using args_t     = promise::args_t<callable_t>;
+   using return_t   = promise::return_t<promise::return_t<callable_t>>;
+   using js_args_t  = typename JsArgs<args_t>::type;
+
+   // The stop token, when taken by the binding, follows the parsed arguments
+   auto const parse = [](std::string_view js_args, std::stop_token stop) {
+      auto args = [&]() constexpr {
+         if constexpr (std::tuple_size_v<js_args_t>) {
+            return js::Parse<js_args_t>(js_args);
+         } else {
+            return std::tuple{};
+         }
+      }();
+
+      if constexpr (JsArgs<args_t>::STOPPABLE) {
+         return std::tuple_cat(std::move(args), std::tuple<std::stop_token>{std::move(stop)});
+      } else {
+         return args;
+      }
+   };
+
+   std::shared_ptr<ThreadPool> executor{};
+   if (options.execution_ == BindOptions::Execution::POOL) {
+      executor = Pool();
+   } else if (options.execution_ == BindOptions::Execution::DEDICATED) {
+      executor = std::make_shared<ThreadPool>(1);
+
+      std::unique_lock lock{executors_mutex_};
+      executors_.emplace_back(executor);
+   }
+
+   // Shared with the calls, which may outlive the binding
+   auto const callable = std::make_shared<callable_t>(std::forward<PROMISE>(promise));
+
+   auto const cache = options.pure_
+                      ? std::make_shared<BindingCache>(options.cache_size_, options.ttl_)
+                      : nullptr;
+   auto const in_flight = options.single_flight_ ? std::make_shared<InFlight>() : nullptr;
+   auto const counters  = std::make_shared<BindingCounters>();
+   auto const admission = options.max_in_flight_ ? std::make_shared<Admission>(
+                                                     options.max_in_flight_,
+                                                     options.max_queued_,
+                                                     options.overflow_,
+                                                     options.priority_
+                                                   )
+                                                 : nullptr;
+
+   auto binding = std::make_shared<binding_t>([this,
+                                               cache,
+                                               in_flight,
+                                               counters,
+                                               admission,
+                                               parse,
+                                               executor,
+                                               callable,
+                                               priority = options.priority_,
+                                               name     = std::string{name}](
+                                                std::string_view id,
+                                                std::string_view js_args,
+                                                std::stop_token  stop
+                                              ) {
+      if (stop_) {
+         return Reply(
+           id, true, js::Stringify(std::string_view{"Terminated webview !"}), priority
+         );
+      }
+
+      assert(promises_);
+      ++counters->calls_;
+
+      if (cache) {
+         if (auto result = cache->Find(js_args); result) {
+            ++counters->cached_;
+            return Reply(id, false, std::move(result), priority);
+         }
+      }
+
+      reply_t reply = [this, guard = guard_, priority, id = std::string{id}](
+                        bool error, std::optional<std::string> result
+                      ) {
+         IfAlive(*guard, [&]() { Reply(id, error, std::move(result), priority); });
+      };
+
+      if (in_flight) {
+         std::unique_lock lock{in_flight->mutex_};
+
+         auto const [elem, inserted] = in_flight->ids_.try_emplace(std::string{js_args});
+         elem->second.emplace_back(id);
+
+         if (!inserted) {
+            // Replied along with the call in flight
+            ++counters->deduplicated_;
+            return;
+         }
+
+         // Shared by the calls joining it, none of them can stop it
+         stop = {};
+
+         reply = [this, guard = guard_, in_flight, priority, params = std::string{js_args}](
+                   bool error, std::optional<std::string> result
+                 ) {
+            std::vector<std::string> ids{};
+            {
+               std::unique_lock flight_lock{in_flight->mutex_};
+
+               // Already replied (e.g. Catch replying after a throwing Then)
+               auto node = in_flight->ids_.extract(params);
+               if (!node) {
+                  return;
                }
+               ids = std::move(node.mapped());
+            }
 
-               assert(promises_);
-
-               try {
-                  auto args = [&]() constexpr {
-                     if constexpr (std::tuple_size_v<args_t>) {
-                        return js::Parse<args_t>(js_args);
-                     } else {
-                        return std::tuple{};
-                     }
-                  }();
-
-                  WPromise<void> wrapper{
-                    std::apply(
-                      [&]<class... ARGS>(ARGS&&... args) constexpr {
-                         return MakeWrapper(promise, id, std::forward<ARGS>(args)...);
-                      },
-                      args
-                    ),
-                  };
+            IfAlive(*guard, [&]() {
+               for (auto const& id : ids) {
+                  Reply(id, error, result, priority);
+               }
+            });
+         };
+      }
+
+      if (cache) {
+         reply = [next = std::move(reply), cache, params = std::string{js_args}](
+                   bool error, std::optional<std::string> result
+                 ) {
+            if (!error && result) {
+               cache->Store(params, *result);
+            }
+            next(error, std::move(result));
+         };
+      }
+
+      // Run from the UI thread, possibly later on when the call was queued,
+      // hence it owns what it uses
+      auto start = [this,
+                    callable,
+                    name,
+                    parse,
+                    executor,
+                    stop,
+                    id     = std::string{id},
+                    params = std::string{js_args}](reply_t const& reply) {
+         if (stop_) {
+            return reply(true, js::Stringify(std::string_view{"Terminated webview !"}));
+         }
+
+         // Aborted while queued, nothing was allocated for it
+         if (stop.stop_requested()) {
+            return reply(true, js::Stringify(std::string_view{"Aborted"}));
+         }
+
+         try {
+            auto wrapper = [&]() constexpr -> WPromise<void> {
+               if (!executor) {
+                  // The callable is kept alive by the reply until the call settles
+                  reply_t held = [callable, reply](
+                                   bool error, std::optional<std::string> result
+                                 ) { reply(error, std::move(result)); };
+
+                  return WPromise<void>{std::apply(
+                    [&]<class... ARGS>(ARGS&&... args) constexpr {
+                       return MakeWrapper(*callable, id, held, std::forward<ARGS>(args)...);
+                    },
+                    parse(params, stop)
+                  )};
+               }
+
+               // Arguments are parsed and the binding is run by the executor,
+               // the reply is dispatched back to the UI thread. The coroutine
+               // takes everything by value, it outlives this scope
+               auto offloaded = [](std::shared_ptr<callable_t> callable,
+                                   std::shared_ptr<ThreadPool> pool,
+                                   std::string                 params,
+                                   std::stop_token             stop,
+                                   decltype(parse)             parse) -> Promise<return_t> {
+                  co_await pool->Schedule();
+
+                  if (stop.stop_requested()) {
+                     throw Exception(error_t::WEBVIEW_ERROR_CANCELED, "Aborted");
+                  }
+
+                  auto call = std::apply(
+                    [&]<class... ARGS>(ARGS&&... args) constexpr {
+                       return MakePromise(*callable, std::forward<ARGS>(args)...);
+                    },
+                    parse(params, stop)
+                  );
+
+                  if constexpr (std::is_void_v<return_t>) {
+                     co_await call;
+                  } else {
+                     co_return co_await call;
+                  }
+               };
+
+               return WPromise<void>{
+                 MakeWrapper(offloaded, id, reply, callable, executor, params, stop, parse)
+               };
+            }();
 
 #ifndef NDEBUG
-                  auto const& [_, emplaced] =
+            auto const& [_, emplaced] =
 #endif  // !NDEBUG
-                    promises_->handles_.emplace(
-                      "bind_" + std::string{id},
-                      Promises::Cleaner{name, std::make_unique<WPromise<void>>(std::move(wrapper))}
-                    );
-                  assert(emplaced);
-
-               } catch (js::SerializableException const& exc) {
-                  Dispatch([id = js::Stringify(id), exception = exc.Stringify(), this]() {
-                     Eval(
-                       R"(window.__webview__.onReply({}, true, {}, "{}"))",
-                       id,
-                       js::Stringify(exception),
-                       nonce_
-                     );
-                  });
-               } catch (std::exception const& exc) {
-                  Dispatch([id        = js::Stringify(id),
-                            exception = js::Stringify(std::string_view{exc.what()}),
-                            this]() {
-                     Eval(
-                       R"(window.__webview__.onReply({}, true, {}, "{}"))",
-                       id,
-                       js::Stringify(exception),
-                       nonce_
-                     );
-                  });
-               } catch (...) {
-                  Dispatch([id = js::Stringify(id), this]() {
-                     Eval(
-                       R"(window.__webview__.onReply({}, true, "unknown exception", "{}"))",
-                       id,
-                       nonce_
-                     );
-                  });
-               }
-            })
-          )
-          .second) {
-      throw Exception(error_t::WEBVIEW_ERROR_DUPLICATE, name);
+              promises_->handles_.emplace(
+                "bind_" + id,
+                Promises::Cleaner{name, std::make_unique<WPromise<void>>(std::move(wrapper))}
+              );
+            assert(emplaced);
+
+         } catch (js::SerializableException const& exc) {
+            reply(true, exc.Stringify());
+         } catch (std::exception const& exc) {
+            reply(true, js::Stringify(std::string_view{exc.what()}));
+         } catch (...) {
+            reply(true, js::Stringify(std::string_view{"unknown exception"}));
+         }
+      };
+
+      if (!admission) {
+         return start(reply);
+      }
+
+      // The slot is released (and handed to the next queued call) once replied
+      reply_t admitted = [this, guard = guard_, admission, counters, next = reply](
+                           bool error, std::optional<std::string> result
+                         ) {
+         next(error, std::move(result));
+         IfAlive(*guard, [&]() { Release(*admission, *counters); });
+      };
+
+      Admit(*admission, *counters, reply, [start, admitted]() { start(admitted); });
+   });
+
+   std::optional<std::string> js_cache{};
+   if (options.pure_ && options.js_cache_) {
+      js_cache = options.ttl_ ? std::format(
+                                  R"({{"size":{},"ttl":{}}})", options.cache_size_, options.ttl_->count()
+                                )
+                              : std::format(R"({{"size":{}}})", options.cache_size_);
    }
 
-   ReplaceBindScript();
+   return {
+     .name_      = std::string{name},
+     .binding_   = std::move(binding),
+     .signature_ = bridge::SIGNATURE<js_args_t>.View(),
+     .js_cache_  = std::move(js_cache),
+     .counters_  = counters
+   };
+}
+
+template <class PROMISE>
+void
+Webview::Bind(std::string_view name, PROMISE&& promise, BindOptions const& options) {
+   AddBindings({MakeBinding(name, std::forward<PROMISE>(promise), options)});
+}
 
-   // Notify that a binding was created if the init script has already
-   // set things up.
-   Eval(
-     R"(if (window.__webview__) {{
-       window.__webview__.onBind({}, "{}")
-   }})",
-     js::Stringify(name),
-     nonce_
+template <class... BINDINGS>
+void
+Webview::BindStatic() {
+   static constexpr auto NAMES      = bridge::NamesArray<BINDINGS::name_...>();
+   static constexpr auto SIGNATURES = bridge::JsonArray<
+     bridge::SIGNATURE<typename JsArgs<
+       promise::args_t<std::remove_cvref_t<decltype(BINDINGS::function_)>>>::type>...>();
+
+   AddStaticBindings(
+     NAMES.View(),
+     SIGNATURES.View(),
+     {MakeBinding(BINDINGS::name_.View(), BINDINGS::function_)...}
    );
 }
 
+template <class PROMISE>
+Webview::BindTransaction&
+Webview::BindTransaction::Bind(
+  std::string_view   name,
+  PROMISE&&          promise,
+  BindOptions const& options
+) {
+   bindings_.emplace_back(webview_.MakeBinding(name, std::forward<PROMISE>(promise), options));
+   return *this;
+}
+
 template <class RETURN, class... ARGS>
 auto&
 Webview::Call(std::string_view name, ARGS&&... args) {
+   return CallImpl<RETURN>(std::nullopt, name, std::forward<ARGS>(args)...);
+}
+
+template <class RETURN, class... ARGS>
+auto&
+Webview::Call(std::chrono::milliseconds timeout, std::string_view name, ARGS&&... args) {
+   return CallImpl<RETURN>(timeout, name, std::forward<ARGS>(args)...);
+}
+
+template <class RETURN, class... ARGS>
+auto&
+Webview::CallImpl(
+  std::optional<std::chrono::milliseconds> timeout,
+  std::string_view                         name,
+  ARGS&&... args
+) {
    std::shared_lock lock{mutex_};
 
    if (stop_) {
@@ -264,6 +448,7 @@ Webview::Call(std::string_view name, ARGS&&... args) {
    auto& promise_ref = *promise_ptr;
    Dispatch([this,
              id,
+             timeout,
              arguments = std::move(std::tuple{std::forward<ARGS>(args)...}),
              name      = std::string{name},
              reject,
@@ -272,8 +457,15 @@ Webview::Call(std::string_view name, ARGS&&... args) {
                std::make_shared<decltype(promise_ptr)>(std::move(promise_ptr))]() constexpr {
       auto const binding = std::make_shared<reverse_binding_t>(
         [this, reject, resolve, id](bool error, std::string_view result) {
+           assert(promises_);
+
+           // Already rejected by PurgeDocument or ExpireCall, the reply was
+           // queued before
+           if (!promises_->handles_.contains("call_" + id)) {
+              return;
+           }
+
            ScopeExit _{[&]() constexpr {
-              assert(promises_);
               auto elem = promises_->handles_.find("call_" + id);
 
               if (elem != promises_->handles_.end()) {
@@ -282,8 +474,6 @@ Webview::Call(std::string_view name, ARGS&&... args) {
                  std::move(elem->second).Detach();
 
                  promises_->handles_.erase(elem);
-              } else {
-                 assert(false);
               }
            }};
 
@@ -300,6 +490,11 @@ Webview::Call(std::string_view name, ARGS&&... args) {
       );
 
       reverse_bindings_.emplace(id, std::move(binding));
+      ++outstanding_calls_;
+
+      if (timeout) {
+         call_timers_.emplace(id, DispatchAfter(*timeout, [this, id]() { ExpireCall(id); }));
+      }
 
       Promises::Cleaner cleaner{name, std::move(*promise_holder), reject};
       [[maybe_unused]] auto const& [_, emplaced] =
@@ -320,6 +515,142 @@ Webview::Call(std::string_view name, ARGS&&... args) {
    return promise_ref;
 }
 
+template <class RETURN>
+auto&
+Webview::Eval(std::string_view js) {
+   std::shared_lock lock{mutex_};
+
+   if (stop_) {
+      throw Exception(error_t::WEBVIEW_ERROR_CANCELED, "Webview is terminating");
+   }
+   assert(promises_);
+
+   auto [promise, resolve, reject] = promise::Pure<RETURN>();
+
+   auto const id = std::to_string(++next_id_);
+
+   auto  promise_ptr = std::make_unique<std::remove_cvref_t<decltype(promise)>>(std::move(promise));
+   auto& promise_ref = *promise_ptr;
+   Dispatch([this,
+             id,
+             script = std::string{js},
+             reject,
+             resolve,
+             promise_holder =
+               std::make_shared<decltype(promise_ptr)>(std::move(promise_ptr))]() constexpr {
+      Promises::Cleaner cleaner{"eval", std::move(*promise_holder), reject};
+      [[maybe_unused]] auto const& [_, emplaced] =
+        promises_->handles_.emplace("eval_" + id, std::move(cleaner));
+      assert(emplaced);
+
+      auto on_result = [this, reject, resolve, id](std::optional<std::string> const& result) {
+         ScopeExit _{[&]() constexpr {
+            assert(promises_);
+            auto elem = promises_->handles_.find("eval_" + id);
+
+            if (elem != promises_->handles_.end()) {
+               // Detach the promise, as there is a slight chance that dispatch
+               // might be executed before the promise completes
+               std::move(elem->second).Detach();
+
+               promises_->handles_.erase(elem);
+            } else {
+               assert(false);
+            }
+         }};
+
+         if (!result) {
+            reject->template Apply<Exception>(
+              error_t::WEBVIEW_ERROR_UNSPECIFIED, "Script execution failed"
+            );
+            return;
+         }
+
+         try {
+            if constexpr (std::is_void_v<std::remove_cvref_t<RETURN>>) {
+               (*resolve)();
+            } else {
+               (*resolve)(js::Parse<RETURN>(*result));
+            }
+         } catch (std::exception const& exc) {
+            reject->template Apply<Exception>(error_t::WEBVIEW_ERROR_INVALID_ARGUMENT, exc.what());
+         }
+      };
+
+      using callback_t = std::function<void(std::optional<std::string> const&)>;
+      Eval(std::string_view{script}, std::optional<callback_t>{std::move(on_result)});
+   });
+
+   return promise_ref;
+}
+
+inline auto&
+Webview::AddUserScriptAsync(std::string_view js) {
+   std::shared_lock lock{mutex_};
+
+   if (stop_) {
+      throw Exception(error_t::WEBVIEW_ERROR_CANCELED, "Webview is terminating");
+   }
+   assert(promises_);
+
+   auto [promise, resolve, reject] = promise::Pure<user_script*>();
+
+   auto const id = std::to_string(++next_id_);
+
+   auto  promise_ptr = std::make_unique<std::remove_cvref_t<decltype(promise)>>(std::move(promise));
+   auto& promise_ref = *promise_ptr;
+   Dispatch([this,
+             id,
+             script = std::string{js},
+             reject,
+             resolve,
+             promise_holder =
+               std::make_shared<decltype(promise_ptr)>(std::move(promise_ptr))]() constexpr {
+      Promises::Cleaner cleaner{"user_script", std::move(*promise_holder), reject};
+      [[maybe_unused]] auto const& [_, emplaced] =
+        promises_->handles_.emplace("script_" + id, std::move(cleaner));
+      assert(emplaced);
+
+      auto* const added = AddUserScript(script);
+
+      OnUserScriptReady(*added, [this, guard = guard_, reject, resolve, id, added](bool ready) {
+         // Already rejected when the webview is terminating: the script may
+         // only be destroyed, and its callbacks invoked, while the members of
+         // the webview are (see CleanPromises)
+         {
+            std::shared_lock guard_lock{guard->mutex_};
+            if (!guard->alive_) {
+               return;
+            }
+         }
+
+         if (!promises_ || !promises_->handles_.contains("script_" + id)) {
+            return;
+         }
+
+         ScopeExit _{[&]() constexpr {
+            auto elem = promises_->handles_.find("script_" + id);
+
+            if (elem != promises_->handles_.end()) {
+               std::move(elem->second).Detach();
+
+               promises_->handles_.erase(elem);
+            }
+         }};
+
+         if (ready) {
+            (*resolve)(added);
+         } else {
+            reject->template Apply<Exception>(
+              error_t::WEBVIEW_ERROR_UNSPECIFIED, "Failed to add user script"
+            );
+         }
+      });
+   });
+
+   return promise_ref;
+}
+
 #if _MSC_VER == 1929
 template <class... ARGS>
 void
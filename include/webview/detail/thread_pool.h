@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace webview {
+
+/// Fixed set of worker threads running posted tasks in order. Pending tasks
+/// are still run on destruction.
+class ThreadPool {
+public:
+   explicit ThreadPool(std::size_t size = std::thread::hardware_concurrency());
+   ~ThreadPool();
+
+   ThreadPool(ThreadPool const&)            = delete;
+   ThreadPool& operator=(ThreadPool const&) = delete;
+   ThreadPool(ThreadPool&&)                 = delete;
+   ThreadPool& operator=(ThreadPool&&)      = delete;
+
+   void Post(std::function<void()> task);
+
+   /// Runs the pending tasks and joins the workers, tasks posted afterwards
+   /// are never run. When called from a worker (the pool released by one of
+   /// its tasks), that worker is detached instead.
+   void Join();
+   /// Same as Join, giving up at deadline: the workers still busy are then
+   /// detached and finish on their own. Returns whether all were joined.
+   bool JoinUntil(std::chrono::steady_clock::time_point deadline);
+
+   /// co_await pool.Schedule() resumes the coroutine on one of the workers
+   auto Schedule() {
+      struct Awaitable {
+         ThreadPool& pool_;
+
+         bool await_ready() const noexcept { return false; }
+         void await_suspend(std::coroutine_handle<> handle) {
+            pool_.Post([handle]() { handle.resume(); });
+         }
+         void await_resume() const noexcept {}
+      };
+
+      return Awaitable{*this};
+   }
+
+private:
+   // Shared with the workers, which outlive the pool once detached
+   struct State {
+      std::mutex                        mutex_{};
+      std::condition_variable           cv_{};
+      std::deque<std::function<void()>> tasks_{};
+      bool                              stop_{false};
+      std::size_t                       running_{0};
+   };
+
+   static void Work(std::shared_ptr<State> state);
+
+   std::shared_ptr<State>   state_{std::make_shared<State>()};
+   std::vector<std::thread> workers_{};
+};
+
+}  // namespace webview
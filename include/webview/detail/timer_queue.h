@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace webview {
+
+/// Tasks run once their deadline is reached, earliest first. Deadlines are
+/// rounded up to a multiple of slack so that timers close to each other fire
+/// together, on a single wake up of the loop. Thread safe.
+///
+/// The clock can be replaced (e.g. by a virtual one), RunDue only relies on it.
+class TimerQueue {
+public:
+   using clock      = std::chrono::steady_clock;
+   using clock_t    = std::function<clock::time_point()>;
+   using time_point = clock::time_point;
+   using Id         = std::uint64_t;
+
+   explicit TimerQueue(
+     std::chrono::milliseconds slack = std::chrono::milliseconds{8},
+     clock_t                   now   = &clock::now
+   );
+
+   time_point Now() const;
+
+   /// Returns the id of the timer, and whether it is now the earliest one
+   std::pair<Id, bool> Add(time_point deadline, std::function<void()> task);
+   /// Returns false if the task already ran (or is running)
+   bool                Cancel(Id id);
+
+   /// Runs the tasks due from the calling thread
+   void                      RunDue();
+   std::optional<time_point> Next() const;
+
+private:
+   time_point Coalesce(time_point deadline) const;
+
+   std::chrono::milliseconds const slack_;
+   clock_t const                   now_;
+
+   mutable std::mutex                                         mutex_{};
+   std::map<std::pair<time_point, Id>, std::function<void()>> timers_{};
+   std::unordered_map<Id, time_point>                         deadlines_{};
+   Id                                                         next_id_{0};
+};
+
+}  // namespace webview
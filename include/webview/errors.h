@@ -42,6 +42,7 @@ namespace webview {
  * - @c WEBVIEW_ERROR_UNSPECIFIED
  * - @c WEBVIEW_ERROR_INVALID_ARGUMENT
  * - @c WEBVIEW_ERROR_INVALID_STATE
+ * - @c WEBVIEW_ERROR_TIMEOUT
  *
  * With the exception of @c WEBVIEW_ERROR_OK which is normally expected,
  * the other common codes do not normally need to be handled specifically.
@@ -66,7 +67,9 @@ enum class error_t {
    /// Signifies that something does not exist.
    WEBVIEW_ERROR_NOT_FOUND = 2,
    /// Signifies that a promise has been rejected.
-   WEBVIEW_ERROR_REJECT = 3
+   WEBVIEW_ERROR_REJECT = 3,
+   /// Signifies that an operation did not complete in time.
+   WEBVIEW_ERROR_TIMEOUT = 4
 };
 
 class ErrorInfo {
@@ -29,6 +29,7 @@
 #include "detail/platform/windows/theme.h"
 #include "utils/Scoped.h"
 
+#include <algorithm>
 #include <format>
 #include <functional>
 #include <optional>
@@ -47,12 +48,53 @@
 #if defined(WEBVIEW_PLATFORM_WINDOWS) && defined(WEBVIEW_EDGE)
 
 namespace webview {
-user_script::impl::impl(std::wstring id, std::wstring code)
-   : id_{std::move(id)}
-   , code_{std::move(code)} {}
+user_script::impl::impl(std::wstring code)
+   : code_{std::move(code)} {}
+
+user_script::impl::~impl() {
+   // The engine may be gone by the time a pending script completes, waiters
+   // are told it failed
+   state_->removed_    = true;
+   auto const on_ready = std::move(state_->on_ready_);
+   state_->on_ready_.clear();
+   for (auto const& callback : on_ready) {
+      callback(false);
+   }
+}
 
 namespace detail {
 
+namespace {
+
+// Dispatched tasks run for at most this long before yielding to the message
+// loop (input, paint)
+constexpr auto DISPATCH_BUDGET = std::chrono::milliseconds{8};
+
+// Tasks waiting longer than this are run before those of higher lanes
+constexpr auto DISPATCH_AGING = std::chrono::milliseconds{100};
+
+// Length of a slice of idle tasks, between two checks of the message queue
+constexpr auto IDLE_BUDGET = std::chrono::milliseconds{4};
+
+// Lane of the dispatched task being run, inherited by Eval
+thread_local Priority current_priority{Priority::NORMAL};
+
+// Timer of the message window running Webview::RunTimers, the other timers
+// are keyed by the address of the coroutine they resume
+constexpr UINT_PTR QUEUE_TIMER = 1;
+
+// Resumes the coroutine whose address is given as lparam
+constexpr UINT WM_RESUME = WM_APP + 1;
+
+UINT
+TimerElapse(std::chrono::milliseconds delay) {
+   return static_cast<UINT>(std::clamp<std::chrono::milliseconds::rep>(
+     delay.count(), USER_TIMER_MINIMUM, USER_TIMER_MAXIMUM
+   ));
+}
+
+}  // namespace
+
 Webview2ComHandler::Webview2ComHandler(msg_cb_t msgCb, webview2_com_handler_cb_t cb)
    : msg_cb_(std::move(msgCb))
    , cb_(std::move(cb)) {}
@@ -294,9 +336,10 @@ Win32EdgeEngine::Win32EdgeEngine(
   DWORD                           style,
   DWORD                           exStyle,
   std::function<void()>           on_terminate,
-  bool                            invisible
+  bool                            invisible,
+  TimerQueue::clock_t             clock
 )
-   : Webview(std::move(on_terminate))
+   : Webview(std::move(on_terminate), std::move(clock))
    , wuser_data_dir_{user_data_dir.has_value() ? std::optional{utils::WidenString(*user_data_dir)} : std::nullopt}
    , options_{std::move(options)}
    , owns_window_{!window}
@@ -506,9 +549,19 @@ Win32EdgeEngine::Win32EdgeEngine(
 
       switch (msg) {
          case WM_APP:
-            if (auto f = reinterpret_cast<std::function<void()>*>(lp); f) {
-               auto _ = std::unique_ptr<std::function<void()>>(f);
-               (*f)();
+            w->DrainDispatchQueue();
+            break;
+         case WM_RESUME: {
+            auto const handle = std::coroutine_handle<>::from_address(reinterpret_cast<void*>(lp));
+            if (w->Unsuspend(handle)) {
+               handle.resume();
+            }
+            break;
+         }
+         case WM_TIMER:
+            KillTimer(hwnd, wp);
+            if (wp == QUEUE_TIMER) {
+               w->RunTimers();
             }
             break;
          case WM_DESTROY:
@@ -555,6 +608,9 @@ Win32EdgeEngine::~Win32EdgeEngine() {
       CleanPromises(std::move(lock));
    }
 
+   // Coroutines whose resumption or timer is still pending are never resumed
+   DestroySuspended();
+
    // We need the message window in order to deplete the event queue.
    SetWindowLongPtrW(message_window_, GWLP_WNDPROC, wndproc);
    DestroyWindow(message_window_);
@@ -595,12 +651,49 @@ Win32EdgeEngine::~Win32EdgeEngine() {
 void
 Win32EdgeEngine::Run() {
    MSG msg;
-   while (GetMessageW(&msg, nullptr, 0, 0) > 0) {
+   while (true) {
+      // Dispatched tasks are drained through WM_APP, nothing is pending once
+      // the queue is empty
+      if (!PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
+         if (RunIdleTasks()) {
+            continue;
+         }
+
+         if (GetMessageW(&msg, nullptr, 0, 0) <= 0) {
+            break;
+         }
+      } else if (msg.message == WM_QUIT) {
+         break;
+      }
+
       TranslateMessage(&msg);
       DispatchMessageW(&msg);
    }
 }
 
+bool
+Win32EdgeEngine::RunIdleTasks() {
+   auto const deadline = std::chrono::steady_clock::now() + IDLE_BUDGET;
+
+   do {
+      idle_task_t task{};
+      {
+         std::unique_lock lock{dispatch_mutex_};
+         if (idle_tasks_.empty()) {
+            return false;
+         }
+
+         task = std::move(idle_tasks_.front());
+         idle_tasks_.pop_front();
+      }
+
+      task(deadline);
+   } while (std::chrono::steady_clock::now() < deadline);
+
+   std::unique_lock lock{dispatch_mutex_};
+   return !idle_tasks_.empty();
+}
+
 HWND
 Win32EdgeEngine::Window() const {
    if (window_) {
@@ -632,8 +725,118 @@ Win32EdgeEngine::Terminate() {
 }
 
 void
-Win32EdgeEngine::Dispatch(std::function<void()> f) {
-   PostMessageW(message_window_, WM_APP, 0, (LPARAM) new std::function<void()>(std::move(f)));
+Win32EdgeEngine::Dispatch(std::function<void()> f, Priority priority) {
+   std::unique_lock lock{dispatch_mutex_};
+
+   dispatch_lanes_[static_cast<std::size_t>(priority)].push_back(
+     {.task_ = std::move(f), .queued_ = std::chrono::steady_clock::now()}
+   );
+
+   if (!drain_posted_) {
+      drain_posted_ = true;
+      PostMessageW(message_window_, WM_APP, 0, 0);
+   }
+}
+
+void
+Win32EdgeEngine::ScheduleTimers(std::chrono::milliseconds delay) {
+   SetTimer(message_window_, QUEUE_TIMER, TimerElapse(delay), nullptr);
+}
+
+void
+Win32EdgeEngine::Resume(std::coroutine_handle<> handle) {
+   PostMessageW(message_window_, WM_RESUME, 0, reinterpret_cast<LPARAM>(handle.address()));
+}
+
+void
+Win32EdgeEngine::DispatchIdle(idle_task_t task) {
+   std::unique_lock lock{dispatch_mutex_};
+   idle_tasks_.push_back(std::move(task));
+
+   // Wakes up the loop, which may be waiting for a message
+   if (idle_tasks_.size() == 1 && !IsUiThread()) {
+      PostMessageW(message_window_, WM_NULL, 0, 0);
+   }
+}
+
+void
+Win32EdgeEngine::DrainDispatchQueue() {
+   auto const start = std::chrono::steady_clock::now();
+
+   // The posted message was just received
+   {
+      std::unique_lock lock{dispatch_mutex_};
+      drain_posted_ = false;
+   }
+
+   // Keeps a message posted while tasks remain, so that a nested message loop
+   // (modal dialog, ...) run by a task drains them
+   auto const post = [this]() {
+      if (!drain_posted_) {
+         drain_posted_ = true;
+         PostMessageW(message_window_, WM_APP, 0, 0);
+      }
+   };
+
+   while (true) {
+      DispatchTask task{};
+      Priority     priority{};
+
+      {
+         std::unique_lock lock{dispatch_mutex_};
+         auto const       now = std::chrono::steady_clock::now();
+
+         std::deque<DispatchTask>* lane{nullptr};
+         for (std::size_t i = 0; i < PRIORITIES; ++i) {
+            auto& current = dispatch_lanes_[i];
+            if (current.empty()) {
+               continue;
+            }
+
+            if (!lane) {
+               lane     = &current;
+               priority = static_cast<Priority>(i);
+            } else if (now - current.front().queued_ > DISPATCH_AGING
+                       && current.front().queued_ < lane->front().queued_) {
+               // Aged, runs before the higher lane
+               lane     = &current;
+               priority = static_cast<Priority>(i);
+            }
+         }
+
+         if (!lane) {
+            return;
+         }
+
+         if (now - start >= DISPATCH_BUDGET) {
+            // Let the message loop handle input and paint in between
+            post();
+            return;
+         }
+
+         task = std::move(lane->front());
+         lane->pop_front();
+
+         auto const pending = std::ranges::any_of(dispatch_lanes_, [](auto const& other) {
+            return !other.empty();
+         });
+         if (pending) {
+            post();
+         }
+      }
+
+      ScopeExit _{[previous = current_priority]() { current_priority = previous; }};
+      current_priority = priority;
+
+      try {
+         task.task_();
+      } catch (...) {
+         // Remaining tasks are run on the next turn
+         std::unique_lock lock{dispatch_mutex_};
+         post();
+         throw;
+      }
+   }
 }
 
 void
@@ -884,17 +1087,25 @@ Win32EdgeEngine::RegisterUrlHandler(std::string_view filter, url_handler_t handl
       };
    }
 
+   // Wildcards become their regex counterpart, anything else matches literally
    auto const reg = [&wfilter]() constexpr {
-      std::wstring res;
+      constexpr std::wstring_view SPECIALS{L".^$|()[]{}+\\"};
+      std::wstring                res;
 
       for (std::size_t i = 0; i < wfilter.length(); ++i) {
-         if ((wfilter[i] == L'*' || wfilter[i] == L'?') && (i == 0 || wfilter[i - 1] != L'\\')) {
-            if (i != 0) {
-               res.pop_back();
-            }
-            res += std::wstring{L"."} + wfilter[i];
+         auto const c = wfilter[i];
+
+         if ((c == L'*' || c == L'?') && (i == 0 || wfilter[i - 1] != L'\\')) {
+            res += std::wstring{L"."} + c;
+         } else if ((c == L'\\') && (i + 1 < wfilter.length())
+                    && (wfilter[i + 1] == L'*' || wfilter[i + 1] == L'?')) {
+            // Escaped wildcard
+            res += c;
          } else {
-            res = wfilter[i];
+            if (SPECIALS.find(c) != std::wstring_view::npos) {
+               res += L'\\';
+            }
+            res += c;
          }
       }
 
@@ -1132,6 +1343,7 @@ Win32EdgeEngine::Eval(
 ) {
    // TODO: Skip if no content has begun loading yet. Can't check with
    //       ICoreWebView2::get_Source because it returns "about:blank".
+   // Scripts evaluated by a dispatched task stay in its lane
    Dispatch([this, wjs = utils::WidenString(js), callback]() constexpr {
       webview_->ExecuteScript(
         wjs.c_str(),
@@ -1148,7 +1360,7 @@ Win32EdgeEngine::Eval(
                                ).Get()
                              : nullptr
       );
-   });
+   }, current_priority);
 }
 
 void
@@ -1158,45 +1370,85 @@ Win32EdgeEngine::SetHtml(std::string_view html) {
 
 user_script
 Win32EdgeEngine::AddUserScriptImpl(std::string_view js) {
-   auto              wjs = utils::WidenString(js);
-   std::wstring      script_id;
-   bool              done{};
-   UserScriptHandler handler{[&script_id, &done](HRESULT res, LPCWSTR id) {
-      if (SUCCEEDED(res)) {
-         script_id = id;
-      }
-      done = true;
-   }};
-   auto              res = webview_->AddScriptToExecuteOnDocumentCreated(wjs.c_str(), &handler);
-   if (SUCCEEDED(res)) {
-      // Sadly we need to pump the even loop in order to get the script ID.
-      while (!done) {
-         DepleteRunLoopEventQueue();
+   auto wjs = utils::WidenString(js);
+   user_script::impl_ptr impl{new user_script::impl{wjs}, [](user_script::impl* p) { delete p; }};
+
+   // The script id is received asynchronously, the script stays pending in
+   // the meantime instead of pumping the event loop
+   Microsoft::WRL::ComPtr<UserScriptHandler> handler{};
+   handler.Attach(new UserScriptHandler{
+     [state   = impl->GetState(),
+      webview = Microsoft::WRL::ComPtr<ICoreWebView2>{webview_}](HRESULT res, LPCWSTR id) {
+        state->ready_ = true;
+        if (SUCCEEDED(res) && id) {
+           state->id_ = id;
+        }
+
+        if (state->removed_) {
+           // Removed while pending
+           if (!state->id_.empty()) {
+              webview->RemoveScriptToExecuteOnDocumentCreated(state->id_.c_str());
+           }
+           return;
+        }
+
+        auto const on_ready = std::move(state->on_ready_);
+        state->on_ready_.clear();
+        for (auto const& callback : on_ready) {
+           callback(!state->id_.empty());
+        }
+     }
+   });
+
+   if (FAILED(webview_->AddScriptToExecuteOnDocumentCreated(wjs.c_str(), handler.Get()))) {
+      impl->GetState()->ready_ = true;
+   }
+
+   return {js, std::move(impl)};
+}
+
+void
+Win32EdgeEngine::OnUserScriptReady(user_script const& script, std::function<void(bool)> callback) {
+   auto const& state = script.get_impl().GetState();
+
+   if (state->ready_ || state->removed_) {
+      callback(!state->removed_ && !state->id_.empty());
+   } else {
+      state->on_ready_.emplace_back(std::move(callback));
+   }
+}
+
+void
+Win32EdgeEngine::RemoveUserScriptImpl(user_script const& script) {
+   auto const& state = script.get_impl().GetState();
+
+   if (state->ready_) {
+      if (!state->id_.empty()) {
+         webview_->RemoveScriptToExecuteOnDocumentCreated(state->id_.c_str());
       }
+      return;
+   }
+
+   // Removed once its id is known
+   state->removed_      = true;
+   auto const on_ready = std::move(state->on_ready_);
+   state->on_ready_.clear();
+   for (auto const& callback : on_ready) {
+      callback(false);
    }
-   // TODO: There's a non-zero chance that we didn't get the script ID.
-   //       We need to convey the error somehow.
-   return {
-     js,
-     user_script::impl_ptr{
-       new user_script::impl{script_id, wjs}, [](user_script::impl* p) { delete p; }
-     }
-   };
 }
 
 void
 Win32EdgeEngine::RemoveAllUserScript(std::list<user_script> const& scripts) {
    for (const auto& script : scripts) {
-      const auto& id = script.get_impl().GetId();
-      webview_->RemoveScriptToExecuteOnDocumentCreated(id.c_str());
+      RemoveUserScriptImpl(script);
    }
 }
 
 bool
 Win32EdgeEngine::AreUserScriptsEqual(user_script const& first, user_script const& second) {
-   const auto& first_id  = first.get_impl().GetId();
-   const auto& second_id = second.get_impl().GetId();
-   return first_id == second_id;
+   // Pending scripts have no id yet
+   return first.get_impl().GetState() == second.get_impl().GetState();
 }
 
 void
@@ -1375,7 +1627,8 @@ Win32EdgeEngine::OnSystemSettingsChange(const wchar_t* area) {
 void
 Win32EdgeEngine::DepleteRunLoopEventQueue() {
    bool done{};
-   Dispatch([&done] { done = true; });
+   // Lowest lane, so that everything dispatched before has run
+   Dispatch([&done] { done = true; }, Priority::BULK);
    while (!done) {
       MSG msg;
       if (GetMessageW(&msg, nullptr, 0, 0) > 0) {
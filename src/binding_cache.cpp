@@ -0,0 +1,66 @@
+#include "detail/binding_cache.h"
+
+#include <utility>
+
+namespace webview {
+
+BindingCache::BindingCache(std::size_t capacity, std::optional<std::chrono::milliseconds> ttl)
+   : capacity_{capacity}
+   , ttl_{ttl} {}
+
+std::optional<std::string>
+BindingCache::Find(std::string_view params) {
+   std::unique_lock lock{mutex_};
+
+   auto const elem = index_.find(params);
+   if (elem == index_.end()) {
+      return std::nullopt;
+   }
+
+   auto const entry = elem->second;
+   if (ttl_ && (entry->expires_ <= clock::now())) {
+      index_.erase(elem);
+      entries_.erase(entry);
+      return std::nullopt;
+   }
+
+   entries_.splice(entries_.begin(), entries_, entry);
+   return entry->result_;
+}
+
+void
+BindingCache::Store(std::string params, std::string result) {
+   if (!capacity_) {
+      return;
+   }
+
+   std::unique_lock lock{mutex_};
+
+   auto const expires = ttl_ ? clock::now() + *ttl_ : clock::time_point::max();
+
+   if (auto const elem = index_.find(params); elem != index_.end()) {
+      elem->second->result_  = std::move(result);
+      elem->second->expires_ = expires;
+      entries_.splice(entries_.begin(), entries_, elem->second);
+      return;
+   }
+
+   if (entries_.size() >= capacity_) {
+      index_.erase(entries_.back().params_);
+      entries_.pop_back();
+   }
+
+   entries_.push_front(
+     {.params_ = std::move(params), .result_ = std::move(result), .expires_ = expires}
+   );
+   index_.emplace(entries_.front().params_, entries_.begin());
+}
+
+void
+BindingCache::Clear() {
+   std::unique_lock lock{mutex_};
+   index_.clear();
+   entries_.clear();
+}
+
+}  // namespace webview
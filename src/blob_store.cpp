@@ -0,0 +1,147 @@
+#include "detail/blob_store.h"
+#include "utils/Nonce.h"
+
+#include <format>
+#include <mutex>
+#include <utility>
+
+namespace webview {
+
+namespace {
+
+std::unordered_multimap<std::string, std::string>
+MakeHeaders() {
+   // Blobs are served from their own origin
+   return {
+     {"Access-Control-Allow-Origin", "*"},
+     {"Access-Control-Allow-Methods", "GET, POST, OPTIONS"},
+     {"Access-Control-Allow-Headers", "*"},
+     {"Cache-Control", "no-store"}
+   };
+}
+
+http::response_t
+MakeResponse(int status, std::string_view reason) {
+   return {
+     .body = {}, .reasonPhrase = std::string{reason}, .statusCode = status, .headers = MakeHeaders()
+   };
+}
+
+}  // namespace
+
+BlobStore::Handle::Handle(std::weak_ptr<BlobStore> store, std::string id)
+   : store_{std::move(store)}
+   , id_{std::move(id)}
+   , url_{std::format("{}/{}", ORIGIN, id_)} {}
+
+BlobStore::Handle::~Handle() {
+   Release();
+}
+
+BlobStore::Handle::Handle(Handle&& other) noexcept {
+   *this = std::move(other);
+}
+
+BlobStore::Handle&
+BlobStore::Handle::operator=(Handle&& other) noexcept {
+   if (this == &other) {
+      return *this;
+   }
+
+   Release();
+   store_ = std::move(other.store_);
+   id_    = std::move(other.id_);
+   url_   = std::move(other.url_);
+   other.store_.reset();
+   return *this;
+}
+
+void
+BlobStore::Handle::Release() {
+   if (auto const store = store_.lock(); store) {
+      store->Remove(id_);
+   }
+   store_.reset();
+}
+
+BlobStore::Handle
+BlobStore::Publish(std::vector<char> data, std::string_view content_type) {
+   return Add(
+     {.data_         = std::make_shared<std::vector<char> const>(std::move(data)),
+      .content_type_ = std::string{content_type},
+      .on_upload_    = nullptr}
+   );
+}
+
+BlobStore::Handle
+BlobStore::Receive(upload_t on_upload) {
+   return Add({.data_ = nullptr, .content_type_ = {}, .on_upload_ = std::move(on_upload)});
+}
+
+BlobStore::Handle
+BlobStore::Add(Blob blob) {
+   std::unique_lock lock{mutex_};
+
+   auto id = utils::Nonce() + utils::Nonce();
+   while (blobs_.contains(id)) {
+      id = utils::Nonce() + utils::Nonce();
+   }
+
+   blobs_.emplace(id, std::move(blob));
+   return {weak_from_this(), std::move(id)};
+}
+
+void
+BlobStore::Remove(std::string const& id) {
+   std::unique_lock lock{mutex_};
+   blobs_.erase(id);
+}
+
+std::optional<http::response_t>
+BlobStore::Serve(http::request_t const& request) {
+   std::string_view uri{request.uri};
+   if (!uri.starts_with(ORIGIN) || !uri.substr(ORIGIN.size()).starts_with('/')) {
+      return MakeResponse(404, "Not Found");
+   }
+
+   uri.remove_prefix(ORIGIN.size() + 1);
+   auto const id = std::string{uri.substr(0, uri.find_first_of("?#"))};
+
+   if (request.method == "OPTIONS") {
+      return MakeResponse(204, "No Content");
+   }
+
+   std::shared_ptr<std::vector<char> const> data{};
+   std::string                              content_type{};
+   upload_t                                 on_upload{};
+
+   {
+      std::unique_lock lock{mutex_};
+      auto const       elem = blobs_.find(id);
+
+      if (elem == blobs_.end()) {
+         return MakeResponse(404, "Not Found");
+      }
+
+      data         = elem->second.data_;
+      content_type = elem->second.content_type_;
+      on_upload    = elem->second.on_upload_;
+   }
+
+   if (request.method == "GET" && data) {
+      auto response = MakeResponse(200, "OK");
+      response.body = *data;
+      response.headers.emplace("Content-Type", content_type);
+      return response;
+   }
+
+   if (request.method == "POST" && on_upload) {
+      auto const content = request.getContent();
+      on_upload({content.begin(), content.end()});
+      return MakeResponse(204, "No Content");
+   }
+
+   return MakeResponse(405, "Method Not Allowed");
+}
+
+}  // namespace webview
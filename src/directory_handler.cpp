@@ -0,0 +1,593 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Serge Zaitsev
+ * Copyright (c) 2022 Steffen André Langnes
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "detail/directory_handler.h"
+#include "detail/engine_base.h"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <json/json.h>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#if defined(_WIN32)
+#   ifndef WIN32_LEAN_AND_MEAN
+#      define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <Windows.h>
+#else
+#   include <poll.h>
+#   include <sys/eventfd.h>
+#   include <sys/inotify.h>
+#   include <unistd.h>
+#endif
+
+namespace webview {
+
+namespace {
+
+// Delay during which change notifications are accumulated before being reported
+constexpr auto DEBOUNCE = std::chrono::milliseconds{50};
+
+std::string
+ToKey(std::filesystem::path const& path) {
+   auto const key = path.lexically_normal().generic_u8string();
+   return {key.begin(), key.end()};
+}
+
+std::optional<std::string>
+Decode(std::string_view value) {
+   std::string result{};
+   result.reserve(value.size());
+
+   for (std::size_t i = 0; i < value.size(); ++i) {
+      if (value[i] != '%') {
+         result += value[i];
+         continue;
+      }
+
+      if (i + 2 >= value.size()) {
+         return std::nullopt;
+      }
+
+      auto const hex = [](char c) -> int {
+         if (c >= '0' && c <= '9') {
+            return c - '0';
+         }
+         if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+         }
+         if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+         }
+         return -1;
+      };
+
+      auto const high = hex(value[i + 1]);
+      auto const low  = hex(value[i + 2]);
+      if (high < 0 || low < 0) {
+         return std::nullopt;
+      }
+
+      result += static_cast<char>((high << 4) | low);
+      i += 2;
+   }
+
+   return result;
+}
+
+// Maps a request uri to a path relative to the served directory, rejecting
+// anything escaping it.
+std::optional<std::string>
+MakeKey(std::string_view uri, std::string_view prefix) {
+   if (!uri.starts_with(prefix)) {
+      return std::nullopt;
+   }
+   uri.remove_prefix(prefix.size());
+   uri = uri.substr(0, uri.find_first_of("?#"));
+
+   auto decoded = Decode(uri);
+   if (!decoded) {
+      return std::nullopt;
+   }
+
+   if (decoded->empty() || decoded->ends_with('/')) {
+      *decoded += "index.html";
+   }
+
+   std::filesystem::path const path{std::u8string{decoded->begin(), decoded->end()}};
+   auto const                  normalized = path.lexically_normal();
+
+   if (normalized.has_root_path() || normalized.empty()
+       || *normalized.begin() == std::filesystem::path{".."}) {
+      return std::nullopt;
+   }
+
+   return ToKey(normalized);
+}
+
+std::string_view
+MimeType(std::filesystem::path const& path) {
+   static std::unordered_map<std::string_view, std::string_view> const MIME_TYPES{
+     {".html", "text/html"},
+     {".htm", "text/html"},
+     {".js", "text/javascript"},
+     {".mjs", "text/javascript"},
+     {".css", "text/css"},
+     {".json", "application/json"},
+     {".map", "application/json"},
+     {".wasm", "application/wasm"},
+     {".svg", "image/svg+xml"},
+     {".png", "image/png"},
+     {".jpg", "image/jpeg"},
+     {".jpeg", "image/jpeg"},
+     {".gif", "image/gif"},
+     {".webp", "image/webp"},
+     {".ico", "image/x-icon"},
+     {".woff", "font/woff"},
+     {".woff2", "font/woff2"},
+     {".ttf", "font/ttf"},
+     {".txt", "text/plain"},
+     {".xml", "application/xml"},
+     {".mp3", "audio/mpeg"},
+     {".wav", "audio/wav"},
+     {".mp4", "video/mp4"},
+   };
+
+   auto const extension = path.extension().string();
+   if (auto const elem = MIME_TYPES.find(extension); elem != MIME_TYPES.end()) {
+      return elem->second;
+   }
+   return "application/octet-stream";
+}
+
+http::response_t
+MakeError(int status, std::string_view reason) {
+   return {
+     .body         = {reason.begin(), reason.end()},
+     .reasonPhrase = std::string{reason},
+     .statusCode   = status,
+     .headers      = {{"Content-Type", "text/plain"}}
+   };
+}
+
+}  // namespace
+
+DirectoryHandler::DirectoryHandler(std::filesystem::path root, std::string_view prefix, bool watch)
+   : cache_{std::make_shared<Cache>()} {
+   cache_->root_   = std::move(root);
+   cache_->prefix_ = std::string{prefix};
+
+   if (watch) {
+      cache_->watched_ = Watch();
+   }
+}
+
+DirectoryHandler::~DirectoryHandler() {
+   stop_ = true;
+
+#if defined(_WIN32)
+   if (stop_event_) {
+      SetEvent(stop_event_);
+   }
+#else
+   if (stop_fd_ >= 0) {
+      eventfd_write(stop_fd_, 1);
+   }
+#endif
+
+   if (watcher_.joinable()) {
+      watcher_.join();
+   }
+
+#if defined(_WIN32)
+   if (stop_event_) {
+      CloseHandle(stop_event_);
+      stop_event_ = nullptr;
+   }
+#else
+   if (stop_fd_ >= 0) {
+      close(stop_fd_);
+      stop_fd_ = -1;
+   }
+#endif
+
+   // Handlers may outlive us, they have to revalidate entries from now on
+   cache_->watched_ = false;
+}
+
+url_handler_t
+DirectoryHandler::Handler() const {
+   return [cache = cache_](http::request_t const& request, std::unique_ptr<MakeDeferred>) {
+      return cache->Serve(request);
+   };
+}
+
+void
+DirectoryHandler::NotifyReload(Webview& webview, bool full_reload) {
+   std::unique_lock lock{reload_mutex_};
+
+   on_changed_ = [&webview, full_reload](std::vector<std::string> const& paths) {
+      if (full_reload) {
+         webview.Eval("window.location.reload()");
+      } else {
+         webview.Eval(
+           R"(window.dispatchEvent(new CustomEvent("webview:reload", {{ detail: {} }})))",
+           js::Stringify(paths)
+         );
+      }
+   };
+}
+
+void
+DirectoryHandler::StopNotify() {
+   // Waits for the notification in progress, if any
+   std::unique_lock lock{reload_mutex_};
+   on_changed_ = nullptr;
+}
+
+void
+DirectoryHandler::Invalidate(std::string_view path) {
+   cache_->Invalidate(path);
+}
+
+void
+DirectoryHandler::Clear() {
+   cache_->Invalidate("");
+}
+
+void
+DirectoryHandler::OnChanged(std::vector<std::string> const& paths) {
+   for (auto const& path : paths) {
+      cache_->Invalidate(path);
+   }
+
+   std::shared_lock lock{reload_mutex_};
+   if (on_changed_) {
+      on_changed_(paths);
+   }
+}
+
+std::optional<http::response_t>
+DirectoryHandler::Cache::Serve(http::request_t const& request) {
+   if (request.method != "GET" && request.method != "HEAD") {
+      return MakeError(405, "Method Not Allowed");
+   }
+
+   auto response = Load(request);
+   if (response && request.method == "HEAD") {
+      // Headers only
+      response->headers.emplace("Content-Length", std::to_string(response->body.size()));
+      response->body.clear();
+   }
+   return response;
+}
+
+std::optional<http::response_t>
+DirectoryHandler::Cache::Load(http::request_t const& request) {
+   auto const key = MakeKey(request.uri, prefix_);
+   if (!key) {
+      return MakeError(404, "Not Found");
+   }
+
+   auto const path = root_ / std::filesystem::path{std::u8string{key->begin(), key->end()}};
+
+   {
+      std::shared_lock lock{mutex_};
+
+      if (auto const elem = entries_.find(*key); elem != entries_.end()) {
+         if (watched_) {
+            return elem->second.response_;
+         }
+
+         std::error_code ec{};
+         auto const      last_write = std::filesystem::last_write_time(path, ec);
+         if (!ec) {
+            auto const size = std::filesystem::file_size(path, ec);
+            if (!ec && last_write == elem->second.last_write_ && size == elem->second.size_) {
+               return elem->second.response_;
+            }
+         }
+      }
+   }
+
+   // Any invalidation occurring while reading makes the entry stale
+   auto const generation = generation_.load();
+
+   std::error_code ec{};
+   if (!std::filesystem::is_regular_file(path, ec)) {
+      return MakeError(404, "Not Found");
+   }
+
+   Entry entry{};
+   entry.last_write_ = std::filesystem::last_write_time(path, ec);
+   entry.size_       = std::filesystem::file_size(path, ec);
+
+   std::ifstream file{path, std::ios::binary};
+   if (ec || !file) {
+      return MakeError(404, "Not Found");
+   }
+
+   entry.response_ = http::response_t{
+     .body         = {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}},
+     .reasonPhrase = "OK",
+     .statusCode   = 200,
+     .headers      = {{"Content-Type", std::string{MimeType(path)}}, {"Cache-Control", "no-cache"}}
+   };
+
+   std::unique_lock lock{mutex_};
+   if (generation != generation_.load()) {
+      return entry.response_;
+   }
+
+   return entries_.insert_or_assign(*key, std::move(entry)).first->second.response_;
+}
+
+void
+DirectoryHandler::Cache::Invalidate(std::string_view path) {
+   std::unique_lock lock{mutex_};
+   ++generation_;
+
+   if (path.empty()) {
+      entries_.clear();
+      return;
+   }
+
+   // The path may denote a directory, drop everything below it too
+   auto const directory = std::string{path} + "/";
+   std::erase_if(entries_, [&](auto const& entry) {
+      return entry.first == path || entry.first.starts_with(directory);
+   });
+}
+
+#if defined(_WIN32)
+
+bool
+DirectoryHandler::Watch() {
+   auto const directory = CreateFileW(
+     cache_->root_.c_str(),
+     FILE_LIST_DIRECTORY,
+     FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+     nullptr,
+     OPEN_EXISTING,
+     FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+     nullptr
+   );
+   if (directory == INVALID_HANDLE_VALUE) {
+      return false;
+   }
+
+   stop_event_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+   if (!stop_event_) {
+      CloseHandle(directory);
+      return false;
+   }
+
+   watcher_ = std::thread{[this, directory]() {
+      constexpr DWORD FILTER = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME
+                               | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+      alignas(DWORD) std::array<std::byte, 64 * 1024> buffer{};
+
+      OVERLAPPED overlapped{};
+      overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+      std::array<HANDLE, 2> const handles{overlapped.hEvent, stop_event_};
+      std::vector<std::string>    pending{};
+      bool                        reading{false};
+
+      while (!stop_ && overlapped.hEvent) {
+         if (!reading) {
+            ResetEvent(overlapped.hEvent);
+            if (!ReadDirectoryChangesW(
+                  directory,
+                  buffer.data(),
+                  static_cast<DWORD>(buffer.size()),
+                  TRUE,
+                  FILTER,
+                  nullptr,
+                  &overlapped,
+                  nullptr
+                )) {
+               break;
+            }
+            reading = true;
+         }
+
+         auto const wait = WaitForMultipleObjects(
+           static_cast<DWORD>(handles.size()),
+           handles.data(),
+           FALSE,
+           pending.empty() ? INFINITE : static_cast<DWORD>(DEBOUNCE.count())
+         );
+
+         if (wait == WAIT_TIMEOUT) {
+            OnChanged(pending);
+            pending.clear();
+            continue;
+         }
+
+         if (wait != WAIT_OBJECT_0) {
+            break;
+         }
+
+         reading = false;
+
+         DWORD bytes{};
+         if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE)) {
+            break;
+         }
+
+         if (!bytes) {
+            // The notification buffer overflowed, we don't know what changed
+            pending.assign({""});
+            continue;
+         }
+
+         for (auto const* data = buffer.data();;) {
+            auto const* info = reinterpret_cast<FILE_NOTIFY_INFORMATION const*>(data);
+            pending.emplace_back(ToKey(std::filesystem::path{std::wstring_view{
+              info->FileName, info->FileNameLength / sizeof(wchar_t)
+            }}));
+
+            if (!info->NextEntryOffset) {
+               break;
+            }
+            data += info->NextEntryOffset;
+         }
+      }
+
+      if (reading) {
+         DWORD bytes{};
+         CancelIoEx(directory, &overlapped);
+         GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+      }
+
+      if (overlapped.hEvent) {
+         CloseHandle(overlapped.hEvent);
+      }
+      CloseHandle(directory);
+   }};
+
+   return true;
+}
+
+#else
+
+bool
+DirectoryHandler::Watch() {
+   auto const fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fd < 0) {
+      return false;
+   }
+
+   stop_fd_ = eventfd(0, EFD_CLOEXEC);
+   if (stop_fd_ < 0) {
+      close(fd);
+      return false;
+   }
+
+   // Inotify isn't recursive, each directory of the tree needs its own watch
+   auto watches   = std::make_shared<std::unordered_map<int, std::filesystem::path>>();
+   auto add_watch = [this, fd, watches](std::filesystem::path const& relative) {
+      constexpr std::uint32_t MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE
+                                     | IN_DELETE_SELF | IN_MOVED_FROM | IN_MOVED_TO;
+
+      auto const add = [&](std::filesystem::path const& path) {
+         auto const wd = inotify_add_watch(fd, (cache_->root_ / path).c_str(), MASK);
+         if (wd >= 0) {
+            (*watches)[wd] = path;
+         }
+      };
+
+      add(relative);
+
+      std::error_code ec{};
+      for (auto it = std::filesystem::recursive_directory_iterator{cache_->root_ / relative, ec};
+           !ec && it != std::filesystem::recursive_directory_iterator{};
+           it.increment(ec)) {
+         if (it->is_directory(ec)) {
+            add(std::filesystem::relative(it->path(), cache_->root_, ec));
+         }
+      }
+   };
+
+   add_watch({});
+   if (watches->empty()) {
+      close(fd);
+      close(stop_fd_);
+      stop_fd_ = -1;
+      return false;
+   }
+
+   watcher_ = std::thread{[this, fd, watches, add_watch]() {
+      alignas(inotify_event) std::array<char, 64 * 1024> buffer{};
+      std::vector<std::string>                           pending{};
+
+      std::array<pollfd, 2> fds{
+        pollfd{.fd = fd, .events = POLLIN, .revents = 0},
+        pollfd{.fd = stop_fd_, .events = POLLIN, .revents = 0}
+      };
+
+      while (!stop_) {
+         auto const ready =
+           poll(fds.data(), fds.size(), pending.empty() ? -1 : static_cast<int>(DEBOUNCE.count()));
+
+         if (ready == 0) {
+            OnChanged(pending);
+            pending.clear();
+            continue;
+         }
+
+         if (ready < 0 || (fds[1].revents & POLLIN)) {
+            break;
+         }
+
+         for (auto length = read(fd, buffer.data(), buffer.size()); length > 0;
+              length      = read(fd, buffer.data(), buffer.size())) {
+            for (auto const* data = buffer.data(); data < buffer.data() + length;) {
+               auto const* event = reinterpret_cast<inotify_event const*>(data);
+               data += sizeof(inotify_event) + event->len;
+
+               if (event->mask & IN_Q_OVERFLOW) {
+                  pending.assign({""});
+                  continue;
+               }
+
+               auto const elem = watches->find(event->wd);
+               if (elem == watches->end()) {
+                  continue;
+               }
+
+               if (event->mask & IN_IGNORED) {
+                  watches->erase(elem);
+                  continue;
+               }
+
+               auto const path = event->len ? elem->second / event->name : elem->second;
+               if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                  add_watch(path);
+               }
+
+               pending.emplace_back(ToKey(path));
+            }
+         }
+      }
+
+      close(fd);
+   }};
+
+   return true;
+}
+
+#endif
+
+}  // namespace webview
@@ -23,6 +23,7 @@
  * SOFTWARE.
  */
 
+#include "detail/bridge_script.h"
 #include "detail/engine_base.h"
 #include "detail/user_script.h"
 #include "promise/promise.h"
@@ -30,13 +31,17 @@
 
 #include "errors.h"
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
 #include <exception>
 #include <format>
 #include <json/json.h>
 #include <mutex>
 #include <shared_mutex>
+#include <thread>
 #include <tuple>
+#include <unordered_set>
 #include <utility>
 #include <variant>
 
@@ -48,8 +53,10 @@ bool Bounds::Contains(Pos const &pos) const {
          (pos.y_ <= y_ + height_);
 }
 
-Webview::Webview(std::function<void()> on_terminate)
-    : on_terminate_(std::move(on_terminate)) {}
+Webview::Webview(std::function<void()> on_terminate,
+                 TimerQueue::clock_t clock)
+    : timers_{std::chrono::milliseconds{8}, std::move(clock)},
+      on_terminate_(std::move(on_terminate)) {}
 
 void Webview::Navigate(std::string_view url) {
   if (url.empty()) {
@@ -59,6 +66,80 @@ void Webview::Navigate(std::string_view url) {
   return NavigateImpl(url);
 }
 
+Webview::BindTransaction::BindTransaction(Webview &webview)
+    : webview_{webview} {}
+
+void Webview::BindTransaction::Commit() {
+  webview_.AddBindings(std::move(bindings_));
+  bindings_.clear();
+}
+
+Webview::BindTransaction Webview::BindAll() { return BindTransaction{*this}; }
+
+void Webview::AddBindings(std::vector<NamedBinding> bindings) {
+  std::unordered_set<std::string_view> names{};
+  for (auto const &binding : bindings) {
+    auto const &name = binding.name_;
+    if (bindings_.contains(name) || static_names_.contains(name) ||
+        !names.emplace(name).second) {
+      throw Exception(error_t::WEBVIEW_ERROR_DUPLICATE, name);
+    }
+  }
+
+  std::vector<std::string> bound{};
+  bound.reserve(bindings.size());
+
+  for (auto &[name, binding, signature, js_cache, counters] : bindings) {
+    bound.emplace_back(name);
+    signatures_.emplace(name, signature);
+    counters_.emplace(name, std::move(counters));
+    if (js_cache) {
+      js_caches_.emplace(name, std::move(*js_cache));
+    }
+    bindings_.emplace(std::move(name), std::move(binding));
+  }
+
+  if (bound.empty()) {
+    return;
+  }
+
+  auto const script = AddBindScript(bound);
+
+  // Notify that bindings were created if the init script has already
+  // set things up.
+  Eval("if (window.__webview__) {{ {} }}", script);
+}
+
+void Webview::AddStaticBindings(std::string_view names,
+                                std::string_view signatures,
+                                std::vector<NamedBinding> bindings) {
+  if (static_bound_) {
+    throw Exception(error_t::WEBVIEW_ERROR_INVALID_STATE,
+                    "Static bindings already set");
+  }
+
+  for (auto const &binding : bindings) {
+    if (bindings_.contains(binding.name_)) {
+      throw Exception(error_t::WEBVIEW_ERROR_DUPLICATE, binding.name_);
+    }
+  }
+
+  static_bound_ = true;
+  static_bindings_.reserve(bindings.size());
+  for (auto &binding : bindings) {
+    counters_.emplace(binding.name_, std::move(binding.counters_));
+    static_names_.emplace(std::move(binding.name_));
+    static_bindings_.emplace_back(std::move(binding.binding_));
+  }
+
+  auto const script = std::string{bridge::STATIC_BIND_SCRIPT} + "(" +
+                      std::string{names} + ", \"" + nonce_ + "\", " +
+                      std::string{signatures} + ")";
+
+  AddUserScript(script);
+  Eval("if (window.__webview__) {{ {} }}", script);
+}
+
 void Webview::Unbind(std::string_view name) {
   if (bindings_.erase(std::string{name}) != 1) {
     throw Exception(
@@ -67,7 +148,10 @@ void Webview::Unbind(std::string_view name) {
                       std::string{name}});
   }
 
-  ReplaceBindScript();
+  signatures_.erase(std::string{name});
+  js_caches_.erase(std::string{name});
+  counters_.erase(std::string{name});
+  RemoveBindScript(std::string{name});
 
   // Notify that a binding was created if the init script has already
   // set things up.
@@ -78,33 +162,433 @@ void Webview::Unbind(std::string_view name) {
       js::Stringify(name), nonce_);
 }
 
+void Webview::SetBindingNamespace(std::string_view name) {
+  if (namespace_script_) {
+    throw Exception(error_t::WEBVIEW_ERROR_INVALID_STATE,
+                    "Binding namespace already set");
+  }
+
+  // Static bindings would stay on window
+  if (!bindings_.empty() || static_bound_) {
+    throw Exception(error_t::WEBVIEW_ERROR_INVALID_STATE,
+                    "Binding namespace must be set before binding");
+  }
+
+  auto const script =
+      std::format(R"(window.__webview__.onNamespace({}, "{}"))",
+                  js::Stringify(name), nonce_);
+
+  // Runs right after the init script in new documents
+  namespace_script_ = AddUserScript(script);
+
+  Eval("if (window.__webview__) {{ {} }}", script);
+}
+
 void Webview::Init(std::string_view js) { AddUserScript(js); }
 
+BindingStats Webview::GetBindingStats(std::string_view name) const {
+  auto const elem = counters_.find(std::string{name});
+  if (elem == counters_.end()) {
+    throw Exception(error_t::WEBVIEW_ERROR_NOT_FOUND, name);
+  }
+
+  auto const &counters = *elem->second;
+  return {.calls_ = counters.calls_,
+          .cached_ = counters.cached_,
+          .deduplicated_ = counters.deduplicated_,
+          .queued_ = counters.queued_,
+          .shed_ = counters.shed_};
+}
+
+std::size_t Webview::OutstandingReverseCalls() const {
+  return outstanding_calls_;
+}
+
+void Webview::PurgeDocument() {
+  for (auto &call : live_calls_) {
+    call.second.request_stop();
+  }
+  live_calls_.clear();
+
+  reverse_bindings_.clear();
+  for (auto const &timer : call_timers_) {
+    timers_.Cancel(timer.second);
+  }
+  call_timers_.clear();
+  outstanding_calls_ = 0;
+
+  if (!promises_) {
+    return;
+  }
+
+  // Running bindings stay tracked until they complete (see CleanPromises),
+  // their reply is dropped as they are no longer live
+  auto &handles = promises_->handles_;
+  for (auto elem = handles.begin(); elem != handles.end();) {
+    if (!elem->first.starts_with("call_")) {
+      ++elem;
+      continue;
+    }
+
+    elem->second.Reject<Exception>(error_t::WEBVIEW_ERROR_CANCELED,
+                                   "Document changed");
+    std::move(elem->second).Detach();
+    elem = handles.erase(elem);
+  }
+}
+
+void Webview::ExpireCall(std::string const &id) {
+  call_timers_.erase(id);
+
+  if (stop_ || !promises_ || !reverse_bindings_.erase(id)) {
+    return;
+  }
+  --outstanding_calls_;
+
+  if (auto elem = promises_->handles_.find("call_" + id);
+      elem != promises_->handles_.end()) {
+    elem->second.Reject<Exception>(error_t::WEBVIEW_ERROR_TIMEOUT,
+                                   "Call timed out");
+    std::move(elem->second).Detach();
+    promises_->handles_.erase(elem);
+  }
+}
+
+TimerQueue::Id Webview::DispatchAfter(std::chrono::milliseconds delay,
+                                      std::function<void()> task) {
+  return DispatchAt(timers_.Now() + delay, std::move(task));
+}
+
+TimerQueue::Id Webview::DispatchAt(TimerQueue::time_point deadline,
+                                   std::function<void()> task) {
+  auto const [id, earliest] = timers_.Add(deadline, std::move(task));
+
+  if (earliest) {
+    if (IsUiThread()) {
+      ArmTimers();
+    } else {
+      // The backend timer belongs to the UI thread
+      Dispatch([this]() { ArmTimers(); }, Priority::INTERACTIVE);
+    }
+  }
+  return id;
+}
+
+bool Webview::CancelDispatch(TimerQueue::Id id) { return timers_.Cancel(id); }
+
+void Webview::RunTimers() {
+  timers_.RunDue();
+  ArmTimers();
+}
+
+bool Webview::Suspend(std::coroutine_handle<> handle) {
+  {
+    std::unique_lock lock{suspended_mutex_};
+    if (!suspended_closed_) {
+      suspended_.emplace(handle.address());
+      return true;
+    }
+  }
+
+  // Would never be resumed
+  handle.destroy();
+  return false;
+}
+
+bool Webview::Unsuspend(std::coroutine_handle<> handle) {
+  std::unique_lock lock{suspended_mutex_};
+  return suspended_.erase(handle.address()) != 0;
+}
+
+void Webview::DestroySuspended() {
+  std::unordered_set<void *> suspended{};
+  {
+    std::unique_lock lock{suspended_mutex_};
+    suspended_closed_ = true;
+    suspended.swap(suspended_);
+  }
+
+  for (auto *const address : suspended) {
+    std::coroutine_handle<>::from_address(address).destroy();
+  }
+}
+
+void Webview::ArmTimers() {
+  if (auto const next = timers_.Next(); next) {
+    ScheduleTimers(std::max(std::chrono::ceil<std::chrono::milliseconds>(
+                                *next - timers_.Now()),
+                            std::chrono::milliseconds{0}));
+  }
+}
+
+Webview::Admission::Admission(std::size_t max_in_flight,
+                              std::size_t max_queued,
+                              BindOptions::Overflow overflow,
+                              Priority priority)
+    : max_in_flight_{max_in_flight}, max_queued_{max_queued},
+      overflow_{overflow}, priority_{priority} {}
+
+void Webview::Admit(Admission &admission, BindingCounters &counters,
+                    reply_t const &reply, std::function<void()> start) {
+  std::optional<Admission::Queued> dropped{};
+  bool rejected{false};
+
+  {
+    std::unique_lock lock{admission.mutex_};
+
+    if (admission.in_flight_ < admission.max_in_flight_) {
+      ++admission.in_flight_;
+      lock.unlock();
+      return start();
+    }
+
+    if ((admission.overflow_ == BindOptions::Overflow::REJECT) ||
+        ((admission.overflow_ == BindOptions::Overflow::FIFO) &&
+         (admission.queue_.size() >= admission.max_queued_))) {
+      rejected = true;
+    } else {
+      if (admission.queue_.size() >= admission.max_queued_) {
+        if (admission.queue_.empty()) {
+          rejected = true;
+        } else {
+          dropped = std::move(admission.queue_.front());
+          admission.queue_.pop_front();
+          --counters.queued_;
+        }
+      }
+
+      if (!rejected) {
+        admission.queue_.push_back(
+            {.reply_ = reply, .start_ = std::move(start)});
+        ++counters.queued_;
+      }
+    }
+  }
+
+  if (rejected) {
+    ++counters.shed_;
+    reply(true, js::Stringify(std::string_view{"Too many calls in flight"}));
+  }
+
+  if (dropped) {
+    ++counters.shed_;
+    dropped->reply_(true,
+                    js::Stringify(std::string_view{"Dropped by a newer call"}));
+  }
+}
+
+void Webview::Release(Admission &admission, BindingCounters &counters) {
+  std::function<void()> next{};
+
+  {
+    std::unique_lock lock{admission.mutex_};
+
+    if (admission.queue_.empty()) {
+      --admission.in_flight_;
+      return;
+    }
+
+    // The slot goes to the next queued call
+    next = std::move(admission.queue_.front().start_);
+    admission.queue_.pop_front();
+    --counters.queued_;
+  }
+
+  // Bindings are started from the UI thread
+  Dispatch(std::move(next), admission.priority_);
+}
+
+void Webview::SetReplyBatchSize(std::size_t size) {
+  std::unique_lock lock{replies_mutex_};
+  reply_batch_size_ = std::max<std::size_t>(size, 1);
+}
+
+void Webview::Dispatch(std::function<void()> f) {
+  Dispatch(std::move(f), Priority::NORMAL);
+}
+
+void Webview::DispatchLatest(std::string_view key, std::function<void()> task,
+                             Priority priority) {
+  std::string id{key};
+  {
+    std::unique_lock lock{latest_mutex_};
+    auto const [elem, inserted] = latest_.try_emplace(id);
+    elem->second = std::move(task);
+
+    // Picked up by the task already dispatched for key
+    if (!inserted) {
+      return;
+    }
+  }
+
+  Dispatch(
+      [this, id = std::move(id)]() {
+        std::function<void()> latest{};
+        {
+          std::unique_lock lock{latest_mutex_};
+          latest = std::move(latest_.extract(id).mapped());
+        }
+        latest();
+      },
+      priority);
+}
+
+void Webview::EvalLatest(std::string_view key, std::string js) {
+  DispatchLatest(key, [this, js = std::move(js)]() {
+    using callback_t = std::function<void(std::optional<std::string> const &)>;
+    Eval(std::string_view{js}, std::optional<callback_t>{});
+  });
+}
+
+bool Webview::IsUiThread() const {
+  return std::this_thread::get_id() == ui_thread_;
+}
+
+void Webview::Reply(std::string_view id, bool error,
+                    std::optional<std::string> result, Priority priority) {
+  std::unique_lock lock{replies_mutex_};
+  auto &lane = reply_lanes_[static_cast<std::size_t>(priority)];
+
+  lane.replies_.emplace_back(PendingReply{
+      .id_ = std::string{id}, .error_ = error, .result_ = std::move(result)});
+
+  // Every reply settled until the flush runs shares its script
+  if (!lane.scheduled_) {
+    lane.scheduled_ = true;
+    Dispatch([this, priority]() { FlushReplies(priority); }, priority);
+  }
+}
+
+void Webview::FlushReplies(Priority priority) {
+  std::vector<PendingReply> replies{};
+  std::size_t batch_size{};
+
+  {
+    std::unique_lock lock{replies_mutex_};
+    auto &lane = reply_lanes_[static_cast<std::size_t>(priority)];
+
+    replies.swap(lane.replies_);
+    lane.scheduled_ = false;
+    batch_size = reply_batch_size_;
+  }
+
+  // Replies of calls aborted or made by a previous document aren't delivered
+  std::erase_if(replies, [this](PendingReply const &reply) {
+    return !live_calls_.erase(reply.id_);
+  });
+
+  for (std::size_t begin = 0; begin < replies.size(); begin += batch_size) {
+    auto const end = std::min(begin + batch_size, replies.size());
+
+    std::string js{"window.__webview__.onReplies(["};
+    for (auto i = begin; i < end; ++i) {
+      auto const &reply = replies[i];
+
+      if (i != begin) {
+        js += ",";
+      }
+      js += std::format("[{},{},{}]", js::Stringify(reply.id_),
+                        reply.error_ ? "true" : "false",
+                        reply.result_ ? js::Stringify(*reply.result_)
+                                      : std::string{"undefined"});
+    }
+    js += std::format(R"(], "{}"))", nonce_);
+
+    Eval(js);
+  }
+}
+
+BlobHandle Webview::PublishBlob(std::vector<char> data,
+                                std::string_view content_type) {
+  return Blobs().Publish(std::move(data), content_type);
+}
+
+BlobHandle Webview::ReceiveBlob(BlobStore::upload_t on_upload) {
+  return Blobs().Receive(std::move(on_upload));
+}
+
+std::shared_ptr<ThreadPool> Webview::Pool() {
+  std::call_once(pool_created_, [this]() {
+    pool_ = std::make_shared<ThreadPool>();
+
+    std::unique_lock lock{executors_mutex_};
+    executors_.emplace_back(pool_);
+  });
+  return pool_;
+}
+
+BlobStore &Webview::Blobs() {
+  std::call_once(blobs_handler_, [this]() {
+    // Url handlers have to be registered from the UI thread
+    Dispatch([this, blobs = blobs_]() {
+      RegisterUrlHandler(std::format("{}/*", BlobStore::ORIGIN),
+                         [blobs](http::request_t const &request,
+                                 std::unique_ptr<MakeDeferred>) {
+                           return blobs->Serve(request);
+                         });
+    });
+  });
+
+  return *blobs_;
+}
+
 user_script *Webview::AddUserScript(std::string_view js) {
   return std::addressof(
       *user_scripts_.emplace(user_scripts_.end(), AddUserScriptImpl(js)));
 }
 
-user_script *Webview::ReplaceUserScript(const user_script &old_script,
-                                        std::string_view new_script_code) {
-  RemoveAllUserScript(user_scripts_);
-  user_script *old_script_ptr{};
-  for (auto &script : user_scripts_) {
-    auto is_old_script = AreUserScriptsEqual(script, old_script);
-    script =
-        AddUserScriptImpl(is_old_script ? new_script_code : script.GetCode());
-    if (is_old_script) {
-      old_script_ptr = std::addressof(script);
-    }
+void Webview::OnUserScriptReady(user_script const &,
+                                std::function<void(bool)> callback) {
+  callback(true);
+}
+
+void Webview::RemoveUserScript(user_script const *script) {
+  auto const elem =
+      std::find_if(user_scripts_.begin(), user_scripts_.end(),
+                   [&](user_script const &current) {
+                     return std::addressof(current) == script;
+                   });
+
+  if (elem == user_scripts_.end()) {
+    throw Exception(error_t::WEBVIEW_ERROR_NOT_FOUND, "Unknown user script");
   }
-  return old_script_ptr;
+
+  RemoveUserScriptImpl(*elem);
+  user_scripts_.erase(elem);
 }
 
-void Webview::ReplaceBindScript() {
-  if (bind_script_) {
-    bind_script_ = ReplaceUserScript(*bind_script_, CreateBindScript());
-  } else {
-    bind_script_ = AddUserScript(CreateBindScript());
+std::string Webview::AddBindScript(std::vector<std::string> const &names) {
+  auto code = CreateBindScript(names);
+  auto *const script = AddUserScript(code);
+
+  // Names unbound from a transaction are moved here from their old script
+  for (auto const &name : names) {
+    bind_scripts_.insert_or_assign(name, script);
+  }
+  script_names_.insert_or_assign(script, names);
+
+  return code;
+}
+
+void Webview::RemoveBindScript(std::string const &name) {
+  auto const elem = bind_scripts_.find(name);
+  if (elem == bind_scripts_.end()) {
+    return;
+  }
+
+  auto *const script = elem->second;
+  bind_scripts_.erase(elem);
+
+  // Scripts registered by a BindTransaction are shared, the other bindings
+  // of the transaction get a new one. Scripts can't be inserted in the middle
+  // of the engine's list, so it now runs after the scripts added since the
+  // transaction: bindings are only meant to be called once the page runs.
+  auto remaining = std::move(script_names_.extract(script).mapped());
+  std::erase(remaining, name);
+
+  RemoveUserScript(script);
+  if (!remaining.empty()) {
+    AddBindScript(remaining);
   }
 }
 
@@ -113,172 +597,35 @@ void Webview::AddInitScript(std::string_view post_fn) {
 }
 
 std::string Webview::CreateInitScript(std::string_view post_fn) {
-  return std::format(
-      R"(
-(function() {{
-   'use strict';
-
-   function generateId() {{
-      var crypto = window.crypto || window.msCrypto;
-      var bytes = new Uint8Array(16);
-      crypto.getRandomValues(bytes);
-        
-      return Array.prototype.slice.call(bytes).map(function(n) {{
-         var s = n.toString(16);
-         return ((s.length % 2) == 1 ? '0' : '') + s;
-      }}).join('');
-   }}
-    
-   var Webview = (function() {{
-      var _promises = {{}};
-      function Webview_() {{}}
-
-      Webview_.prototype.post = function(message, nonce) {{
-         return ({0})(message, nonce);
-      }};
-
-      Webview_.prototype.call = function(method, nonce) {{
-         if (nonce != "{1}") {{
-            throw new Error('Invalid nonce \"' + nonce + '\"');
-         }}
-
-         var _id = generateId();
-         var _params = Array.prototype.slice.call(arguments, 2);
-         var promise = new Promise(function(resolve, reject) {{
-            _promises[_id] = {{ resolve, reject }};
-         }});
-
-         this.post(JSON.stringify({{
-               nonce: nonce,
-               reverse: false,
-               id: _id,
-               method: method,
-               params: JSON.stringify(_params)
-            }}),
-            nonce);
-
-         return promise;
-      }};
-
-      Webview_.prototype.reverseCall = function(method, _id, nonce, _params) {{
-         if (nonce != "{1}") {{
-            throw new Error('Invalid nonce \"' + nonce + '\"');
-         }}
-
-         if (!window.hasOwnProperty(method)) {{
-            this.post(JSON.stringify({{
-                  nonce: nonce,
-                  reverse: true,
-                  id: _id,
-                  method: method,
-                  error: true,
-                  result: JSON.stringify('Property \"' + method + '\" doesn\'t exists')
-               }}),
-               nonce);
-         }} else {{
-            window[method].apply(null, _params).then((result) => {{
-               this.post(JSON.stringify({{
-                     nonce: nonce,
-                     reverse: true,
-                     id: _id,
-                     method: method,
-                     error: false,
-                     result: JSON.stringify(result)
-                  }}),
-                  nonce);
-            }}).catch((error) => {{
-               this.post(JSON.stringify({{
-                     nonce: nonce,
-                     reverse: true,
-                     id: _id,
-                     method: method,
-                     error: true,
-                     result: JSON.stringify(error)
-                  }}),
-                  nonce);
-            }});
-         }}
-      }}
-
-      Webview_.prototype.onReply = function(id, error, result, nonce) {{
-         if (nonce != "{1}") {{
-            throw new Error('Invalid nonce \"' + nonce + '\"');
-         }}
-
-         var promise = _promises[id];
-         if (result !== undefined) {{
-            try {{
-               result = JSON.parse(result);
-            }} catch (e) {{
-               promise.reject(new Error("Failed to Parse binding result as JSON"));
-               return;
-            }}
-         }}
-
-         if (error) {{
-            promise.reject(result);
-         }} else {{
-            promise.resolve(result);
-         }}
-      }};
-
-      Webview_.prototype.onBind = function(name, nonce) {{
-         if (nonce != "{1}") {{
-            throw new Error('Invalid nonce \"' + nonce + '\"');
-         }}
-
-         if (window.hasOwnProperty(name)) {{
-            throw new Error('Property \"' + name + '\" already Exists');
-         }}
-
-         window[name] = (function() {{
-            var params = [name, nonce].concat(Array.prototype.slice.call(arguments));
-            return Webview_.prototype.call.apply(this, params);
-         }}).bind(this);
-      }};
-
-      Webview_.prototype.onUnbind = function(name, nonce) {{
-         if (nonce != "{1}") {{
-            throw new Error('Invalid nonce \"' + nonce + '\"');
-         }}
-         if (!window.hasOwnProperty(name)) {{
-            throw new Error('Property \"' + name + '\" does not exist');
-         }}
-
-         delete window[name];
-      }};
-
-      return Webview_;
-   }})();
-  
-   window.__webview__ = new Webview();
-}})())",
-      post_fn, nonce_);
-}
-
-std::string Webview::CreateBindScript() {
+  return std::string{bridge::INIT_SCRIPT} + "(" + std::string{post_fn} +
+         ", \"" + nonce_ + "\")";
+}
+
+std::string Webview::CreateBindScript(std::vector<std::string> const &names) {
   std::string js_names = "[";
+  std::string js_signatures = "[";
+  std::string js_caches = "[";
   bool first = true;
-  for (const auto &binding : bindings_) {
+  for (const auto &name : names) {
     if (first) {
       first = false;
     } else {
       js_names += ",";
+      js_signatures += ",";
+      js_caches += ",";
     }
-    js_names += js::Stringify(binding.first);
+    js_names += js::Stringify(name);
+    js_signatures += js::Stringify(signatures_.at(name));
+
+    auto const js_cache = js_caches_.find(name);
+    js_caches += js_cache == js_caches_.end() ? "null" : js_cache->second;
   }
   js_names += "]";
+  js_signatures += "]";
+  js_caches += "]";
 
-  return std::format(
-      R"((function() {{
-    'use strict';
-    var methods = {};
-
-    methods.forEach(function(name) {{
-        window.__webview__.onBind(name, "{}");
-    }});
-}})())",
-      js_names, nonce_);
+  return std::string{bridge::BIND_SCRIPT} + "(" + js_names + ", \"" + nonce_ +
+         "\", " + js_signatures + ", " + js_caches + ")";
 }
 
 struct Header {
@@ -286,22 +633,33 @@ struct Header {
   bool reverse_;
   std::string id_;
   std::string name_;
+  std::optional<std::string> document_;
 
   static constexpr js::Proto PROTOTYPE{
       js::_{"nonce", &Header::nonce_},
       js::_{"reverse", &Header::reverse_},
       js::_{"id", &Header::id_},
       js::_{"method", &Header::name_},
+      js::_{"document", &Header::document_},
   };
 };
 
 struct ReplyMessage : Header {
   std::string params_;
+  // Set for static bindings
+  std::optional<std::size_t> index_;
+  // Sent once the signal of the call with the same id aborts
+  std::optional<bool> cancel_;
+  // First message of a document
+  std::optional<bool> hello_;
 
   static constexpr js::Proto PROTOTYPE{
       js::Extend{
           Header::PROTOTYPE,
           js::_{"params", &ReplyMessage::params_},
+          js::_{"index", &ReplyMessage::index_},
+          js::_{"cancel", &ReplyMessage::cancel_},
+          js::_{"hello", &ReplyMessage::hello_},
       },
   };
 };
@@ -322,45 +680,125 @@ struct ReverseMessage : Header {
 using Message = std::variant<ReverseMessage, ReplyMessage>;
 
 void Webview::OnMessage(std::string_view msg_) {
-  auto const check_header = [this](auto msg) constexpr {
+  auto const check_header = [this](auto const &msg) constexpr {
     if (msg.nonce_ != nonce_) {
       std::cerr << "Invalid nonce !" << std::endl;
       // ignoring
       return false;
     }
+    // Posted by a previous document before it went away
+    if (msg.document_ && !document_.empty() && *msg.document_ != document_) {
+      return false;
+    }
     return true;
   };
 
-  auto vmsg = js::Parse<Message>(msg_);
+  std::vector<std::function<void()>> tasks{};
 
-  if (std::holds_alternative<ReplyMessage>(vmsg)) {
-    auto const &msg = std::get<ReplyMessage>(vmsg);
-    if (check_header(msg)) {
-      assert(!msg.reverse_);
+  auto const handle = [&](Message const &vmsg) {
+    if (std::holds_alternative<ReplyMessage>(vmsg)) {
+      auto const &msg = std::get<ReplyMessage>(vmsg);
 
-      auto const &create_promise = bindings_.at(std::string{msg.name_});
+      if (msg.hello_.value_or(false)) {
+        if (msg.nonce_ == nonce_ && msg.document_ &&
+            *msg.document_ != document_) {
+          PurgeDocument();
+          document_ = *msg.document_;
+        }
+        return;
+      }
 
-      Dispatch([create_promise, id = std::string{msg.id_},
-                params = std::string{msg.params_}]() {
-        (*create_promise)(id, params);
-      });
-    }
-  } else {
-    auto const &msg = std::get<ReverseMessage>(vmsg);
-    if (check_header(msg)) {
-      assert(msg.reverse_);
-
-      if (auto elem = reverse_bindings_.find(std::string{msg.id_});
-          elem != reverse_bindings_.end()) {
-        auto make_reply = std::move(elem->second);
-        reverse_bindings_.erase(elem);
-
-        Dispatch([make_reply, error = msg.error_,
-                  result = std::string{msg.result_ ? *msg.result_ : ""}]() {
-          (*make_reply)(error, result);
+      if (check_header(msg)) {
+        assert(!msg.reverse_);
+
+        // Stopped right away, the call may still be queued in tasks
+        if (msg.cancel_.value_or(false)) {
+          if (auto elem = live_calls_.find(msg.id_);
+              elem != live_calls_.end()) {
+            elem->second.request_stop();
+            live_calls_.erase(elem);
+          }
+          return;
+        }
+
+        auto const stop = live_calls_[msg.id_].get_token();
+
+        // Rejected alone, the other calls of the batch go on
+        std::shared_ptr<binding_t> create_promise{};
+        if (msg.index_) {
+          if (*msg.index_ < static_bindings_.size()) {
+            create_promise = static_bindings_[*msg.index_];
+          }
+        } else if (auto elem = bindings_.find(std::string{msg.name_});
+                   elem != bindings_.end()) {
+          create_promise = elem->second;
+        }
+
+        if (!create_promise) {
+          Reply(msg.id_, true,
+                js::Stringify(std::format("Unknown binding \"{}\"",
+                                          std::string_view{msg.name_})));
+          return;
+        }
+
+        tasks.emplace_back([create_promise, id = std::string{msg.id_},
+                            params = std::string{msg.params_},
+                            stop = std::move(stop)]() {
+          (*create_promise)(id, params, stop);
         });
       }
+    } else {
+      auto const &msg = std::get<ReverseMessage>(vmsg);
+      if (check_header(msg)) {
+        assert(msg.reverse_);
+
+        if (auto elem = reverse_bindings_.find(std::string{msg.id_});
+            elem != reverse_bindings_.end()) {
+          auto make_reply = std::move(elem->second);
+          reverse_bindings_.erase(elem);
+          --outstanding_calls_;
+
+          if (auto timer = call_timers_.find(std::string{msg.id_});
+              timer != call_timers_.end()) {
+            timers_.Cancel(timer->second);
+            call_timers_.erase(timer);
+          }
+
+          tasks.emplace_back(
+              [make_reply, error = msg.error_,
+               result = std::string{msg.result_ ? *msg.result_ : ""}]() {
+                (*make_reply)(error, result);
+              });
+        }
+      }
+    }
+  };
+
+  // Messages posted during the same JS task come batched as an array
+  if (auto const begin = msg_.find_first_not_of(" \t\r\n");
+      begin != std::string_view::npos && msg_[begin] == '[') {
+    for (auto const &msg : js::Parse<std::vector<Message>>(msg_)) {
+      handle(msg);
     }
+  } else {
+    handle(js::Parse<Message>(msg_));
+  }
+
+  if (tasks.size() == 1) {
+    Dispatch(std::move(tasks.front()));
+  } else if (!tasks.empty()) {
+    Dispatch([tasks = std::move(tasks)]() {
+      // A failing task doesn't prevent the next ones from running
+      for (auto const &task : tasks) {
+        try {
+          task();
+        } catch (std::exception const &e) {
+          std::cerr << e.what() << std::endl;
+        } catch (...) {
+          std::cerr << "unknown exception" << std::endl;
+        }
+      }
+    });
   }
 }
 
@@ -427,48 +865,102 @@ void Webview::Promises::Cleaner::Detach() && {
 
 Webview::SLock Webview::Lock() { return SLock{mutex_}; }
 
+void Webview::SetShutdownTimeout(std::chrono::milliseconds timeout) {
+  shutdown_timeout_ = timeout;
+}
+
 void Webview::CleanPromises(Webview::SLock &&lock) {
   assert(promises_);
-  auto promises = std::move(promises_);
+
+  // Shared with the coroutines awaiting the handles, which outlive this call
+  // when some handle doesn't settle in time
+  struct Shutdown {
+    std::unique_ptr<Promises> promises_{};
+    std::mutex mutex_{};
+    std::condition_variable cv_{};
+    std::unordered_set<std::string_view> pending_{};
+  };
+
+  auto const shutdown = std::make_shared<Shutdown>();
+  shutdown->promises_ = std::move(promises_);
   assert(!promises_);
 
-  std::condition_variable_any cv{};
-  bool done{false};
+  auto &handles = shutdown->promises_->handles_;
+  auto const deadline = std::chrono::steady_clock::now() + shutdown_timeout_;
 
   lock.unlock();
-  auto promise = MakePromise([this, &cv, &done, &promises]() -> Promise<void> {
-    struct Done {
-      std::condition_variable_any &cv_;
-      std::shared_mutex &mutex_;
-      bool &done_;
-
-      ~Done() {
-        std::unique_lock lock{mutex_};
-        done_ = true;
-        cv_.notify_all();
-      }
-    } _{.cv_ = cv, .mutex_ = mutex_, .done_ = done};
-
-    for (auto &handle : promises->handles_) {
-      try {
-        handle.second.Reject<Exception>(error_t::WEBVIEW_ERROR_CANCELED,
-                                        "Webview is terminating");
-        co_await handle.second;
-      } catch (std::exception const &e) {
-        std::cerr << e.what() << std::endl;
+
+  for (auto &[id, handle] : handles) {
+    shutdown->pending_.emplace(id);
+    handle.Reject<Exception>(error_t::WEBVIEW_ERROR_CANCELED,
+                             "Webview is terminating");
+  }
+
+  // Awaited concurrently, each awaiting coroutine is detached and frees
+  // itself once done
+  for (auto &[id, handle] : handles) {
+    std::unique_ptr<promise::VPromise> awaiting =
+        std::make_unique<WPromise<void>>(WPromise<void>{MakePromise(
+        [shutdown, &handle, id = std::string_view{id}]() -> Promise<void> {
+          try {
+            co_await handle;
+          } catch (Exception const &e) {
+            if (e.error().Code() != error_t::WEBVIEW_ERROR_CANCELED) {
+              std::cerr << e.what() << std::endl;
+            }
+          } catch (std::exception const &e) {
+            std::cerr << e.what() << std::endl;
+          }
+
+          std::unique_lock shutdown_lock{shutdown->mutex_};
+          shutdown->pending_.erase(id);
+          if (shutdown->pending_.empty()) {
+            shutdown->cv_.notify_all();
+          }
+        })});
+    std::move(*awaiting).VDetach();
+  }
+
+  {
+    std::unique_lock shutdown_lock{shutdown->mutex_};
+    if (!shutdown->cv_.wait_until(shutdown_lock, deadline, [&]() {
+          return shutdown->pending_.empty();
+        })) {
+      std::cerr << "Promises not settled on shutdown:";
+      for (auto const id : shutdown->pending_) {
+        std::cerr << " " << handles.at(std::string{id}).Name() << " (" << id
+                  << ")";
       }
+      std::cerr << std::endl;
     }
+  }
 
-    co_return;
-  });
+  // The bindings still unsettled no longer reach this webview
+  {
+    std::unique_lock guard_lock{guard_->mutex_};
+    guard_->alive_ = false;
+  }
 
-  lock.lock();
-  if (!done) {
-    cv.wait(lock);
+  // The executors are given what remains of the deadline, the bindings still
+  // running afterwards complete on detached workers, away from this webview
+  std::vector<std::shared_ptr<ThreadPool>> executors{};
+  {
+    std::unique_lock executors_lock{executors_mutex_};
+    for (auto const &executor : executors_) {
+      if (auto pool = executor.lock(); pool) {
+        executors.emplace_back(std::move(pool));
+      }
+    }
+    executors_.clear();
+  }
+
+  for (auto const &executor : executors) {
+    if (!executor->JoinUntil(deadline)) {
+      std::cerr << "Executor not joined on shutdown" << std::endl;
+    }
   }
 
-  assert(promise.Done());
-  assert(!promise.Exception());
+  lock.lock();
 }
 
 } // namespace webview
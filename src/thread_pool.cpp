@@ -0,0 +1,100 @@
+#include "detail/thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace webview {
+
+ThreadPool::ThreadPool(std::size_t size) {
+   size = std::max<std::size_t>(size, 1);
+
+   state_->running_ = size;
+
+   workers_.reserve(size);
+   for (std::size_t i = 0; i < size; ++i) {
+      workers_.emplace_back(&ThreadPool::Work, state_);
+   }
+}
+
+ThreadPool::~ThreadPool() {
+   Join();
+}
+
+void
+ThreadPool::Join() {
+   {
+      std::unique_lock lock{state_->mutex_};
+      state_->stop_ = true;
+   }
+   state_->cv_.notify_all();
+
+   for (auto& worker : workers_) {
+      if (!worker.joinable()) {
+         continue;
+      }
+
+      if (worker.get_id() == std::this_thread::get_id()) {
+         worker.detach();
+      } else {
+         worker.join();
+      }
+   }
+}
+
+bool
+ThreadPool::JoinUntil(std::chrono::steady_clock::time_point deadline) {
+   {
+      std::unique_lock lock{state_->mutex_};
+      state_->stop_ = true;
+      state_->cv_.notify_all();
+
+      if (!state_->cv_.wait_until(lock, deadline, [&]() { return !state_->running_; })) {
+         lock.unlock();
+
+         for (auto& worker : workers_) {
+            if (worker.joinable()) {
+               worker.detach();
+            }
+         }
+         return false;
+      }
+   }
+
+   // The workers are exiting
+   Join();
+   return true;
+}
+
+void
+ThreadPool::Post(std::function<void()> task) {
+   {
+      std::unique_lock lock{state_->mutex_};
+      state_->tasks_.emplace_back(std::move(task));
+   }
+   state_->cv_.notify_one();
+}
+
+void
+ThreadPool::Work(std::shared_ptr<State> state) {
+   while (true) {
+      std::function<void()> task{};
+
+      {
+         std::unique_lock lock{state->mutex_};
+         state->cv_.wait(lock, [&]() { return state->stop_ || !state->tasks_.empty(); });
+
+         if (state->tasks_.empty()) {
+            --state->running_;
+            state->cv_.notify_all();
+            return;
+         }
+
+         task = std::move(state->tasks_.front());
+         state->tasks_.pop_front();
+      }
+
+      task();
+   }
+}
+
+}  // namespace webview
@@ -0,0 +1,83 @@
+#include "detail/timer_queue.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace webview {
+
+TimerQueue::TimerQueue(std::chrono::milliseconds slack, clock_t now)
+   : slack_{std::max(slack, std::chrono::milliseconds{1})}
+   , now_{std::move(now)} {}
+
+TimerQueue::time_point
+TimerQueue::Now() const {
+   return now_();
+}
+
+TimerQueue::time_point
+TimerQueue::Coalesce(time_point deadline) const {
+   auto const since = std::chrono::ceil<std::chrono::milliseconds>(deadline.time_since_epoch());
+   auto const slots = (since.count() + slack_.count() - 1) / slack_.count();
+
+   return time_point{std::chrono::duration_cast<clock::duration>(slots * slack_)};
+}
+
+std::pair<TimerQueue::Id, bool>
+TimerQueue::Add(time_point deadline, std::function<void()> task) {
+   deadline = Coalesce(deadline);
+
+   std::unique_lock lock{mutex_};
+   auto const       id       = ++next_id_;
+   auto const       earliest = timers_.empty() || deadline < timers_.begin()->first.first;
+
+   timers_.emplace(std::pair{deadline, id}, std::move(task));
+   deadlines_.emplace(id, deadline);
+   return {id, earliest};
+}
+
+bool
+TimerQueue::Cancel(Id id) {
+   std::unique_lock lock{mutex_};
+
+   auto const elem = deadlines_.find(id);
+   if (elem == deadlines_.end()) {
+      return false;
+   }
+
+   timers_.erase({elem->second, id});
+   deadlines_.erase(elem);
+   return true;
+}
+
+void
+TimerQueue::RunDue() {
+   auto const now = Now();
+
+   std::vector<std::function<void()>> due{};
+   {
+      std::unique_lock lock{mutex_};
+
+      while (!timers_.empty() && timers_.begin()->first.first <= now) {
+         auto node = timers_.extract(timers_.begin());
+         deadlines_.erase(node.key().second);
+         due.emplace_back(std::move(node.mapped()));
+      }
+   }
+
+   // Tasks may add or cancel timers
+   for (auto const& task : due) {
+      task();
+   }
+}
+
+std::optional<TimerQueue::time_point>
+TimerQueue::Next() const {
+   std::unique_lock lock{mutex_};
+
+   if (timers_.empty()) {
+      return std::nullopt;
+   }
+   return timers_.begin()->first.first;
+}
+
+}  // namespace webview